@@ -34,10 +34,20 @@
     do {                                                                                        \
         eth_module_config[num].spi_cs_gpio = CONFIG_ETHERNET_SPI_CS ##num## _GPIO;           \
         eth_module_config[num].int_gpio = CONFIG_ETHERNET_SPI_INT ##num## _GPIO;             \
+        eth_module_config[num].poll_period_ms = SPI_ETH_POLLING_MS(num);                     \
         eth_module_config[num].phy_reset_gpio = CONFIG_ETHERNET_SPI_PHY_RST ##num## _GPIO;   \
         eth_module_config[num].phy_addr = CONFIG_ETHERNET_SPI_PHY_ADDR ##num;                \
     } while(0)
 
+// Polling period of a module without interrupt line, 0 when the interrupt line is used
+#define SPI_ETH_POLLING_MS(num) (CONFIG_ETHERNET_SPI_INT ##num## _GPIO < 0 ? CONFIG_ETHERNET_SPI_POLLING ##num## _MS : 0)
+#if !defined(CONFIG_ETHERNET_SPI_POLLING0_MS)
+#define CONFIG_ETHERNET_SPI_POLLING0_MS 0
+#endif
+#if !defined(CONFIG_ETHERNET_SPI_POLLING1_MS)
+#define CONFIG_ETHERNET_SPI_POLLING1_MS 0
+#endif
+
 #if !defined(CONFIG_ETHERNET_INTERNAL_SUPPORT)
 #define CONFIG_ETHERNET_INTERNAL_SUPPORT 0
 #endif
@@ -48,7 +58,8 @@
 
 typedef struct {
     uint8_t spi_cs_gpio;
-    uint8_t int_gpio;
+    int8_t int_gpio;
+    uint32_t poll_period_ms;
     int8_t phy_reset_gpio;
     uint8_t phy_addr;
     uint8_t *mac_addr;
@@ -112,6 +123,20 @@ void eth_event_handler(void *arg, esp_event_base_t event_base,
 }
 
 
+/**
+ * @brief Apply the RX task placement from the board configuration
+ *
+ * @param[out] mac_config common MAC configuration to update
+ */
+static void eth_init_rx_task_config(eth_mac_config_t *mac_config)
+{
+    mac_config->rx_task_prio = CONFIG_ETHERNET_RX_TASK_PRIO;
+    mac_config->rx_task_stack_size = CONFIG_ETHERNET_RX_TASK_STACK_SIZE;
+#if CONFIG_ETHERNET_RX_TASK_PIN_TO_CORE
+    mac_config->flags |= ETH_MAC_FLAG_PIN_TO_CORE;
+#endif
+}
+
 #if CONFIG_ETHERNET_INTERNAL_SUPPORT
 /**
  * @brief Internal ESP32 Ethernet initialization
@@ -132,6 +157,7 @@ static esp_eth_handle_t eth_init_internal(eth_device *dev_out)
 
     // Init common MAC configs to default
     eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
+    eth_init_rx_task_config(&mac_config);
 
     // Init vendor specific MAC config to default
     eth_esp32_emac_config_t esp32_emac_config = ETH_ESP32_EMAC_DEFAULT_CONFIG();
@@ -253,6 +279,7 @@ static esp_eth_handle_t eth_init_spi(spi_eth_module_config_t *spi_eth_module_con
     // Init common MAC and PHY configs to default
     eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
     eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
+    eth_init_rx_task_config(&mac_config);
 
     // Update PHY config based on board specific configuration
     phy_config.phy_addr = spi_eth_module_config->phy_addr;
@@ -270,18 +297,21 @@ static esp_eth_handle_t eth_init_spi(spi_eth_module_config_t *spi_eth_module_con
 #if CONFIG_ETHERNET_USE_KSZ8851SNL
     eth_ksz8851snl_config_t ksz8851snl_config = ETH_KSZ8851SNL_DEFAULT_CONFIG(CONFIG_ETHERNET_SPI_HOST, &spi_devcfg);
     ksz8851snl_config.int_gpio_num = spi_eth_module_config->int_gpio;
+    ksz8851snl_config.poll_period_ms = spi_eth_module_config->poll_period_ms;
     dev->mac = esp_eth_mac_new_ksz8851snl(&ksz8851snl_config, &mac_config);
     dev->phy = esp_eth_phy_new_ksz8851snl(&phy_config);
     sprintf(dev->dev_info.name, "KSZ8851SNL");
 #elif CONFIG_ETHERNET_USE_DM9051
     eth_dm9051_config_t dm9051_config = ETH_DM9051_DEFAULT_CONFIG(CONFIG_ETHERNET_SPI_HOST, &spi_devcfg);
     dm9051_config.int_gpio_num = spi_eth_module_config->int_gpio;
+    dm9051_config.poll_period_ms = spi_eth_module_config->poll_period_ms;
     dev->mac = esp_eth_mac_new_dm9051(&dm9051_config, &mac_config);
     dev->phy = esp_eth_phy_new_dm9051(&phy_config);
     sprintf(dev->dev_info.name, "DM9051");
 #elif CONFIG_ETHERNET_USE_W5500
     eth_w5500_config_t w5500_config = ETH_W5500_DEFAULT_CONFIG(CONFIG_ETHERNET_SPI_HOST, &spi_devcfg);
     w5500_config.int_gpio_num = spi_eth_module_config->int_gpio;
+    w5500_config.poll_period_ms = spi_eth_module_config->poll_period_ms;
     dev_out->mac = esp_eth_mac_new_w5500(&w5500_config, &mac_config);
     dev_out->phy = esp_eth_phy_new_w5500(&phy_config);
     sprintf(dev_out->dev_info.name, "W5500");
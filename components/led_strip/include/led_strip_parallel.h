@@ -0,0 +1,54 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "led_strip_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maximum number of strips driven by one parallel LED strip object
+ */
+#define LED_STRIP_PARALLEL_MAX_LANES 16
+
+/**
+ * @brief LED Strip parallel output specific configuration
+ *
+ * @note Each lane is a strip of `max_leds` LEDs (see `led_strip_config_t`) on its own data line. Pixel `index`
+ *       of the object is LED `index % max_leds` of lane `index / max_leds`. `strip_gpio_num` of the LED strip
+ *       configuration is not used.
+ */
+typedef struct {
+    uint8_t lane_count;                                 /*!< Number of lanes, 8 or 16 */
+    int lane_gpio_nums[LED_STRIP_PARALLEL_MAX_LANES];   /*!< Data line GPIO of each lane */
+    int clk_gpio_num;                                   /*!< GPIO for the bus clock, required by the peripheral but not connected to the strips */
+    int dc_gpio_num;                                    /*!< GPIO for the bus D/C signal, required by the peripheral but not connected to the strips */
+} led_strip_parallel_config_t;
+
+/**
+ * @brief Create LED strips driven in parallel by the I80 (I2S/LCD) bus
+ * @note The whole I80 bus is taken by the strips. Every refresh sends all the lanes at once: the time taken
+ *       by a refresh is the one of a single lane.
+ *
+ * @param led_config LED strip configuration, `max_leds` is the number of LEDs of each lane
+ * @param parallel_config parallel output specific configuration
+ * @param ret_strip Returned LED strip handle
+ * @return
+ *      - ESP_OK: create LED strip handle successfully
+ *      - ESP_ERR_INVALID_ARG: create LED strip handle failed because of invalid argument
+ *      - ESP_ERR_NOT_SUPPORTED: create LED strip handle failed because of unsupported configuration
+ *      - ESP_ERR_NO_MEM: create LED strip handle failed because of out of memory
+ *      - ESP_FAIL: create LED strip handle failed because some other error
+ */
+esp_err_t led_strip_new_parallel_device(const led_strip_config_t *led_config, const led_strip_parallel_config_t *parallel_config, led_strip_handle_t *ret_strip);
+
+#ifdef __cplusplus
+}
+#endif
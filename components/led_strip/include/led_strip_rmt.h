@@ -21,6 +21,9 @@ typedef struct {
     rmt_clock_source_t clk_src; /*!< RMT clock source */
     uint32_t resolution_hz;     /*!< RMT tick resolution, if set to zero, a default resolution (10MHz) will be applied */
     size_t mem_block_symbols;   /*!< How many RMT symbols can one RMT channel hold at one time. Set to 0 will fallback to use the default size. */
+    uint8_t *pixel_buf;         /*!< Caller-provided pixel buffer of max_leds * bytes per pixel bytes, it must outlive the strip and be in internal RAM (DMA capable with with_dma). Set to NULL to allocate it together with the strip object */
+    rmt_tx_done_callback_t on_trans_done; /*!< Optional, called from the RMT ISR when a refresh has been sent. Must be IRAM safe when CONFIG_RMT_ISR_IRAM_SAFE is set */
+    void *user_ctx;             /*!< User context passed to on_trans_done */
     struct {
         uint32_t with_dma: 1;   /*!< Use DMA to transmit data */
     } flags;
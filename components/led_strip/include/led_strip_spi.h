@@ -20,8 +20,11 @@ extern "C" {
 typedef struct {
     spi_clock_source_t clk_src; /*!< SPI clock source */
     spi_host_device_t spi_bus;  /*!< SPI bus ID. Which buses are available depends on the specific chip */
+    uint8_t *pixel_buf;         /*!< Stream mode only: caller-provided buffer of max_leds * bytes per pixel raw GRB(W) bytes, it must outlive the strip. Set to NULL to allocate it together with the strip object */
     struct {
         uint32_t with_dma: 1;   /*!< Use DMA to transmit data */
+        uint32_t stream: 1;     /*!< Keep the pixels unencoded and encode them on refresh into two small DMA buffers sent in turn, instead of holding the whole strip encoded (3 bytes per color byte) in DMA memory. Exclusive with async_refresh */
+        uint32_t async_refresh: 1; /*!< Queue the transmission and return without waiting for it. Pixels are then encoded into a second buffer while the first one is sent, which doubles the pixel memory */
     } flags;
 } led_strip_spi_config_t;
 
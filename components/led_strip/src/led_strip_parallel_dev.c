@@ -0,0 +1,177 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/cdefs.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_lcd_panel_io.h"
+#include "led_strip.h"
+#include "led_strip_interface.h"
+#include "led_strip_parallel_encoder.h"
+
+// Same bit timing as the SPI backend: a color bit takes 3 bus clocks, 100 for 0 and 110 for 1
+#define LED_STRIP_PARALLEL_RESOLUTION (2.5 * 1000 * 1000) // 2.5MHz resolution
+// all lanes low for the reset code, 50us like the RMT backend
+#define PARALLEL_RESET_SLOTS (LED_STRIP_PARALLEL_RESOLUTION / 1000000 * 50)
+
+static const char *TAG = "led_strip_parallel";
+
+typedef struct {
+    led_strip_t base;
+    esp_lcd_i80_bus_handle_t bus;
+    esp_lcd_panel_io_handle_t io;
+    SemaphoreHandle_t done_sem;  // given when the waveform has been sent
+    uint32_t strip_len;          // LEDs per lane
+    uint8_t bytes_per_pixel;
+    uint8_t lane_count;
+    uint8_t bus_bytes;           // bytes of a bus word, one bit per lane
+    uint8_t *wave_buf;           // bus words sent to the lanes, DMA capable
+    size_t wave_size;
+    uint8_t pixel_buf[];         // raw color bytes, [led][color][lane]
+} led_strip_parallel_obj;
+
+static esp_err_t led_strip_parallel_set_pixel_rgbw(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white)
+{
+    led_strip_parallel_obj *parallel_strip = __containerof(strip, led_strip_parallel_obj, base);
+    ESP_RETURN_ON_FALSE(index < parallel_strip->strip_len * parallel_strip->lane_count, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
+    uint32_t lane = index / parallel_strip->strip_len;
+    uint32_t led = index % parallel_strip->strip_len;
+    uint32_t lanes = parallel_strip->lane_count;
+    uint8_t *color = parallel_strip->pixel_buf + led * parallel_strip->bytes_per_pixel * lanes + lane;
+    // GRB(W) component order
+    color[0] = green;
+    color[lanes] = red;
+    color[lanes * 2] = blue;
+    if (parallel_strip->bytes_per_pixel > 3) {
+        color[lanes * 3] = white;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_parallel_set_pixel(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue)
+{
+    return led_strip_parallel_set_pixel_rgbw(strip, index, red, green, blue, 0);
+}
+
+static bool led_strip_parallel_trans_done(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_io_event_data_t *edata, void *user_ctx)
+{
+    led_strip_parallel_obj *parallel_strip = (led_strip_parallel_obj *)user_ctx;
+    BaseType_t high_task_woken = pdFALSE;
+    xSemaphoreGiveFromISR(parallel_strip->done_sem, &high_task_woken);
+    return high_task_woken == pdTRUE;
+}
+
+static esp_err_t led_strip_parallel_refresh(led_strip_t *strip)
+{
+    led_strip_parallel_obj *parallel_strip = __containerof(strip, led_strip_parallel_obj, base);
+    __led_strip_parallel_encode(parallel_strip->pixel_buf, parallel_strip->strip_len * parallel_strip->bytes_per_pixel,
+                                parallel_strip->lane_count, parallel_strip->wave_buf);
+
+    ESP_RETURN_ON_ERROR(esp_lcd_panel_io_tx_color(parallel_strip->io, -1, parallel_strip->wave_buf, parallel_strip->wave_size),
+                        TAG, "transmit waveform failed");
+    xSemaphoreTake(parallel_strip->done_sem, portMAX_DELAY);
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_parallel_clear(led_strip_t *strip)
+{
+    led_strip_parallel_obj *parallel_strip = __containerof(strip, led_strip_parallel_obj, base);
+    memset(parallel_strip->pixel_buf, 0, parallel_strip->strip_len * parallel_strip->bytes_per_pixel * parallel_strip->lane_count);
+    return led_strip_parallel_refresh(strip);
+}
+
+static esp_err_t led_strip_parallel_del(led_strip_t *strip)
+{
+    led_strip_parallel_obj *parallel_strip = __containerof(strip, led_strip_parallel_obj, base);
+    ESP_RETURN_ON_ERROR(esp_lcd_panel_io_del(parallel_strip->io), TAG, "delete panel io failed");
+    ESP_RETURN_ON_ERROR(esp_lcd_del_i80_bus(parallel_strip->bus), TAG, "delete i80 bus failed");
+    vSemaphoreDelete(parallel_strip->done_sem);
+    free(parallel_strip->wave_buf);
+    free(parallel_strip);
+    return ESP_OK;
+}
+
+esp_err_t led_strip_new_parallel_device(const led_strip_config_t *led_config, const led_strip_parallel_config_t *parallel_config, led_strip_handle_t *ret_strip)
+{
+    led_strip_parallel_obj *parallel_strip = NULL;
+    esp_err_t ret = ESP_OK;
+    ESP_GOTO_ON_FALSE(led_config && parallel_config && ret_strip, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
+    ESP_GOTO_ON_FALSE(led_config->led_pixel_format < LED_PIXEL_FORMAT_INVALID, ESP_ERR_INVALID_ARG, err, TAG, "invalid led_pixel_format");
+    ESP_GOTO_ON_FALSE(parallel_config->lane_count == 8 || parallel_config->lane_count == 16, ESP_ERR_INVALID_ARG, err, TAG, "lane_count must be 8 or 16");
+    ESP_GOTO_ON_FALSE(!led_config->flags.invert_out, ESP_ERR_NOT_SUPPORTED, err, TAG, "invert_out not supported");
+    uint8_t bytes_per_pixel = led_config->led_pixel_format == LED_PIXEL_FORMAT_GRBW ? 4 : 3;
+    uint32_t lanes = parallel_config->lane_count;
+    size_t pixel_size = led_config->max_leds * bytes_per_pixel * lanes;
+    parallel_strip = calloc(1, sizeof(led_strip_parallel_obj) + pixel_size);
+    ESP_GOTO_ON_FALSE(parallel_strip, ESP_ERR_NO_MEM, err, TAG, "no mem for parallel strip");
+
+    parallel_strip->bytes_per_pixel = bytes_per_pixel;
+    parallel_strip->strip_len = led_config->max_leds;
+    parallel_strip->lane_count = lanes;
+    parallel_strip->bus_bytes = lanes / 8;
+    size_t slots = led_config->max_leds * bytes_per_pixel * PARALLEL_SLOTS_PER_COLOR_BYTE + PARALLEL_RESET_SLOTS;
+    parallel_strip->wave_size = slots * parallel_strip->bus_bytes;
+    // read by the DMA, must be in internal SRAM
+    parallel_strip->wave_buf = heap_caps_calloc(1, parallel_strip->wave_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA);
+    ESP_GOTO_ON_FALSE(parallel_strip->wave_buf, ESP_ERR_NO_MEM, err, TAG, "no mem for waveform buffer");
+    // every bit starts with all the lanes high, the reset code stays all low
+    for (size_t slot = 0; slot < slots - PARALLEL_RESET_SLOTS; slot += PARALLEL_SLOTS_PER_BIT) {
+        memset(parallel_strip->wave_buf + slot * parallel_strip->bus_bytes, 0xFF, parallel_strip->bus_bytes);
+    }
+    parallel_strip->done_sem = xSemaphoreCreateBinary();
+    ESP_GOTO_ON_FALSE(parallel_strip->done_sem, ESP_ERR_NO_MEM, err, TAG, "no mem for semaphore");
+
+    esp_lcd_i80_bus_config_t bus_config = {
+        .dc_gpio_num = parallel_config->dc_gpio_num,
+        .wr_gpio_num = parallel_config->clk_gpio_num,
+        .clk_src = LCD_CLK_SRC_DEFAULT,
+        .bus_width = lanes,
+        .max_transfer_bytes = parallel_strip->wave_size,
+    };
+    for (uint32_t i = 0; i < lanes; i++) {
+        bus_config.data_gpio_nums[i] = parallel_config->lane_gpio_nums[i];
+    }
+    ESP_GOTO_ON_ERROR(esp_lcd_new_i80_bus(&bus_config, &parallel_strip->bus), err, TAG, "create i80 bus failed");
+
+    esp_lcd_panel_io_i80_config_t io_config = {
+        .cs_gpio_num = -1,
+        .pclk_hz = LED_STRIP_PARALLEL_RESOLUTION,
+        .trans_queue_depth = 1,
+        .on_color_trans_done = led_strip_parallel_trans_done,
+        .user_ctx = parallel_strip,
+        .lcd_cmd_bits = 8,
+        .lcd_param_bits = 8,
+    };
+    ESP_GOTO_ON_ERROR(esp_lcd_new_panel_io_i80(parallel_strip->bus, &io_config, &parallel_strip->io), err, TAG, "create panel io failed");
+
+    parallel_strip->base.set_pixel = led_strip_parallel_set_pixel;
+    parallel_strip->base.set_pixel_rgbw = led_strip_parallel_set_pixel_rgbw;
+    parallel_strip->base.refresh = led_strip_parallel_refresh;
+    parallel_strip->base.clear = led_strip_parallel_clear;
+    parallel_strip->base.del = led_strip_parallel_del;
+
+    *ret_strip = &parallel_strip->base;
+    return ESP_OK;
+err:
+    if (parallel_strip) {
+        if (parallel_strip->io) {
+            esp_lcd_panel_io_del(parallel_strip->io);
+        }
+        if (parallel_strip->bus) {
+            esp_lcd_del_i80_bus(parallel_strip->bus);
+        }
+        if (parallel_strip->done_sem) {
+            vSemaphoreDelete(parallel_strip->done_sem);
+        }
+        free(parallel_strip->wave_buf);
+        free(parallel_strip);
+    }
+    return ret;
+}
@@ -0,0 +1,71 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Waveform encoding of the parallel backend, plain C so that test_host/ can build it
+// on the host.
+
+// A color bit takes 3 bus words: all lanes high, the bit of each lane, all lanes low
+#define PARALLEL_SLOTS_PER_BIT 3
+#define PARALLEL_SLOTS_PER_COLOR_BYTE (PARALLEL_SLOTS_PER_BIT * 8)
+
+// Transposes the 8x8 bit matrix made of one color byte of each of 8 lanes. On return
+// bits[j] holds bit 7 - j (colors are sent MSB first) of every lane, lane n in bit n,
+// which is the bus word sending that bit to the 8 lanes at once. Three rounds of masked
+// swaps on two 32-bit words, no loop over the bits and no branch.
+static inline void __led_strip_parallel_transpose8(const uint8_t *lanes, uint8_t *bits)
+{
+    uint32_t y; // lanes 0..3, lane 0 in the low byte
+    uint32_t x; // lanes 4..7
+    memcpy(&y, lanes, sizeof(y));
+    memcpy(&x, lanes + 4, sizeof(x));
+    uint32_t t;
+    // swap the 1x1 blocks, then the 2x2 blocks within each 4x4 block
+    t = (x ^ (x >> 7)) & 0x00AA00AA;
+    x = x ^ t ^ (t << 7);
+    t = (y ^ (y >> 7)) & 0x00AA00AA;
+    y = y ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC;
+    x = x ^ t ^ (t << 14);
+    t = (y ^ (y >> 14)) & 0x0000CCCC;
+    y = y ^ t ^ (t << 14);
+    // swap the 4x4 blocks across the two words
+    t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+    y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+    x = t;
+    bits[0] = x >> 24;
+    bits[1] = x >> 16;
+    bits[2] = x >> 8;
+    bits[3] = x;
+    bits[4] = y >> 24;
+    bits[5] = y >> 16;
+    bits[6] = y >> 8;
+    bits[7] = y;
+}
+
+// Writes the middle slot of every bit of color_bytes color bytes of 8 or 16 lanes into
+// wave. colors is [color byte][lane]; wave holds PARALLEL_SLOTS_PER_COLOR_BYTE bus
+// words of lanes / 8 bytes per color byte. The high and low slots of every bit never
+// change and are not written.
+static inline void __led_strip_parallel_encode(const uint8_t *colors, uint32_t color_bytes, uint32_t lanes, uint8_t *wave)
+{
+    uint32_t bus_bytes = lanes / 8;
+    uint8_t *slot = wave + bus_bytes;
+    const uint8_t *color = colors;
+    uint8_t bits[8];
+    for (uint32_t i = 0; i < color_bytes; i++, color += lanes) {
+        for (uint32_t group = 0; group < bus_bytes; group++) {
+            __led_strip_parallel_transpose8(color + group * 8, bits);
+            for (int bit = 0; bit < 8; bit++) {
+                slot[bit * PARALLEL_SLOTS_PER_BIT * bus_bytes + group] = bits[bit];
+            }
+        }
+        slot += PARALLEL_SLOTS_PER_COLOR_BYTE * bus_bytes;
+    }
+}
@@ -8,6 +8,7 @@
 #include <sys/cdefs.h>
 #include "esp_log.h"
 #include "esp_check.h"
+#include "esp_heap_caps.h"
 #include "driver/rmt_tx.h"
 #include "led_strip.h"
 #include "led_strip_interface.h"
@@ -30,7 +31,8 @@ typedef struct {
     rmt_encoder_handle_t strip_encoder;
     uint32_t strip_len;
     uint8_t bytes_per_pixel;
-    uint8_t pixel_buf[];
+    uint8_t *pixel_buf;
+    uint8_t pixel_storage[];
 } led_strip_rmt_obj;
 
 static esp_err_t led_strip_rmt_set_pixel(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue)
@@ -108,8 +110,16 @@ esp_err_t led_strip_new_rmt_device(const led_strip_config_t *led_config, const l
     } else {
         assert(false);
     }
-    rmt_strip = calloc(1, sizeof(led_strip_rmt_obj) + led_config->max_leds * bytes_per_pixel);
+    // the pixel buffer lives right after the object, unless the caller provides one
+    size_t pixel_storage_size = rmt_config->pixel_buf ? 0 : led_config->max_leds * bytes_per_pixel;
+    // the encoder reads the pixel buffer from the RMT ISR, keep it out of PSRAM
+    uint32_t mem_caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    if (rmt_config->flags.with_dma) {
+        mem_caps |= MALLOC_CAP_DMA;
+    }
+    rmt_strip = heap_caps_calloc(1, sizeof(led_strip_rmt_obj) + pixel_storage_size, mem_caps);
     ESP_GOTO_ON_FALSE(rmt_strip, ESP_ERR_NO_MEM, err, TAG, "no mem for rmt strip");
+    rmt_strip->pixel_buf = rmt_config->pixel_buf ? rmt_config->pixel_buf : rmt_strip->pixel_storage;
     uint32_t resolution = rmt_config->resolution_hz ? rmt_config->resolution_hz : LED_STRIP_RMT_DEFAULT_RESOLUTION;
 
     // for backward compatibility, if the user does not set the clk_src, use the default value
@@ -132,6 +142,12 @@ esp_err_t led_strip_new_rmt_device(const led_strip_config_t *led_config, const l
         .flags.invert_out = led_config->flags.invert_out,
     };
     ESP_GOTO_ON_ERROR(rmt_new_tx_channel(&rmt_chan_config, &rmt_strip->rmt_chan), err, TAG, "create RMT TX channel failed");
+    if (rmt_config->on_trans_done) {
+        rmt_tx_event_callbacks_t cbs = {
+            .on_trans_done = rmt_config->on_trans_done,
+        };
+        ESP_GOTO_ON_ERROR(rmt_tx_register_event_callbacks(rmt_strip->rmt_chan, &cbs, rmt_config->user_ctx), err, TAG, "register RMT callback failed");
+    }
 
     led_strip_encoder_config_t strip_encoder_conf = {
         .resolution = resolution,
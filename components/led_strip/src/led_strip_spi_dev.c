@@ -0,0 +1,337 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/cdefs.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_rom_gpio.h"
+#include "soc/spi_periph.h"
+#include "led_strip.h"
+#include "led_strip_interface.h"
+#include "hal/spi_hal.h"
+#include "led_strip_spi_encoder.h"
+
+#define LED_STRIP_SPI_DEFAULT_RESOLUTION (2.5 * 1000 * 1000) // 2.5MHz resolution
+#define LED_STRIP_SPI_DEFAULT_TRANS_QUEUE_SIZE 4
+
+// DMA buffers must be word aligned, or the SPI driver copies them into a bounce buffer
+#define SPI_DMA_ALIGNED_SIZE(size) (((size) + 3) & ~3)
+// size of each of the two encoded buffers of the streaming mode
+#define LED_STRIP_SPI_STREAM_CHUNK_SIZE 576
+
+static const char *TAG = "led_strip_spi";
+
+typedef struct {
+    led_strip_t base;
+    spi_host_device_t spi_host;
+    spi_device_handle_t spi_device;
+    uint32_t strip_len;
+    uint8_t bytes_per_pixel;
+    bool async_refresh;
+    bool trans_pending;          // trans is queued and not reaped yet
+    spi_transaction_t trans;     // must stay valid while queued
+    uint8_t *pixel_buf;          // buffer written by set_pixel
+    // streaming mode: pixel_buf holds raw GRB(W) bytes, encoded chunk by chunk on refresh
+    uint8_t *chunk_buf[2];
+    spi_transaction_t chunk_trans[2];
+    uint32_t chunk_color_bytes;  // color bytes encoded in one chunk
+    uint8_t pixel_storage[];     // one encoded buffer, two with async_refresh, raw pixels when streaming
+} led_strip_spi_obj;
+
+static esp_err_t led_strip_spi_set_pixel(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    ESP_RETURN_ON_FALSE(index < spi_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
+    // LED_PIXEL_FORMAT_GRB takes 72bits(9bytes)
+    uint32_t start = index * spi_strip->bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE;
+    memset(spi_strip->pixel_buf + start, 0, spi_strip->bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE);
+    __led_strip_spi_bit(green, &spi_strip->pixel_buf[start]);
+    __led_strip_spi_bit(red, &spi_strip->pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE]);
+    __led_strip_spi_bit(blue, &spi_strip->pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE * 2]);
+    if (spi_strip->bytes_per_pixel > 3) {
+        __led_strip_spi_bit(0, &spi_strip->pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE * 3]);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_spi_set_pixel_rgbw(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    ESP_RETURN_ON_FALSE(index < spi_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
+    ESP_RETURN_ON_FALSE(spi_strip->bytes_per_pixel == 4, ESP_ERR_INVALID_ARG, TAG, "wrong LED pixel format, expected 4 bytes per pixel");
+    // LED_PIXEL_FORMAT_GRBW takes 96bits(12bytes)
+    uint32_t start = index * spi_strip->bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE;
+    // SK6812 component order is GRBW
+    memset(spi_strip->pixel_buf + start, 0, spi_strip->bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE);
+    __led_strip_spi_bit(green, &spi_strip->pixel_buf[start]);
+    __led_strip_spi_bit(red, &spi_strip->pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE]);
+    __led_strip_spi_bit(blue, &spi_strip->pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE * 2]);
+    __led_strip_spi_bit(white, &spi_strip->pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE * 3]);
+
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_spi_stream_set_pixel_rgbw(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    ESP_RETURN_ON_FALSE(index < spi_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
+    uint8_t *pixel = spi_strip->pixel_buf + index * spi_strip->bytes_per_pixel;
+    pixel[0] = green;
+    pixel[1] = red;
+    pixel[2] = blue;
+    if (spi_strip->bytes_per_pixel > 3) {
+        pixel[3] = white;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_spi_stream_set_pixel(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue)
+{
+    return led_strip_spi_stream_set_pixel_rgbw(strip, index, red, green, blue, 0);
+}
+
+// encode the color bytes [offset, offset + count) into a chunk buffer and queue it
+static esp_err_t led_strip_spi_stream_queue_chunk(led_strip_spi_obj *spi_strip, int chunk, uint32_t offset, uint32_t count)
+{
+    uint8_t *buf = spi_strip->chunk_buf[chunk];
+    memset(buf, 0, count * SPI_BYTES_PER_COLOR_BYTE);
+    for (uint32_t i = 0; i < count; i++) {
+        __led_strip_spi_bit(spi_strip->pixel_buf[offset + i], buf + i * SPI_BYTES_PER_COLOR_BYTE);
+    }
+    spi_transaction_t *trans = &spi_strip->chunk_trans[chunk];
+    memset(trans, 0, sizeof(*trans));
+    trans->length = count * SPI_BITS_PER_COLOR_BYTE;
+    trans->tx_buffer = buf;
+    return spi_device_queue_trans(spi_strip->spi_device, trans, portMAX_DELAY);
+}
+
+// Keeps both chunk buffers in the SPI queue: while one is sent, the other one, already
+// sent, is refilled with the next chunk. The SPI master driver cannot queue from its
+// ISR, so the refill runs here, woken up by each completed transaction. The line is
+// low between two chunks, a gap far shorter than the latch time.
+static esp_err_t led_strip_spi_stream_refresh(led_strip_t *strip)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    uint32_t total = spi_strip->strip_len * spi_strip->bytes_per_pixel;
+    uint32_t offset = 0;
+    int in_flight = 0;
+    for (int chunk = 0; chunk < 2 && offset < total; chunk++) {
+        uint32_t count = MIN(spi_strip->chunk_color_bytes, total - offset);
+        ESP_RETURN_ON_ERROR(led_strip_spi_stream_queue_chunk(spi_strip, chunk, offset, count), TAG, "queue chunk failed");
+        offset += count;
+        in_flight++;
+    }
+    while (in_flight > 0) {
+        spi_transaction_t *done = NULL;
+        ESP_RETURN_ON_ERROR(spi_device_get_trans_result(spi_strip->spi_device, &done, portMAX_DELAY), TAG, "wait for chunk failed");
+        in_flight--;
+        if (offset < total) {
+            uint32_t count = MIN(spi_strip->chunk_color_bytes, total - offset);
+            int chunk = done == &spi_strip->chunk_trans[0] ? 0 : 1;
+            ESP_RETURN_ON_ERROR(led_strip_spi_stream_queue_chunk(spi_strip, chunk, offset, count), TAG, "queue chunk failed");
+            offset += count;
+            in_flight++;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_spi_stream_clear(led_strip_t *strip)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    memset(spi_strip->pixel_buf, 0, spi_strip->strip_len * spi_strip->bytes_per_pixel);
+    return led_strip_spi_stream_refresh(strip);
+}
+
+// wait for the transaction queued by the previous asynchronous refresh
+static esp_err_t led_strip_spi_wait_pending(led_strip_spi_obj *spi_strip)
+{
+    if (!spi_strip->trans_pending) {
+        return ESP_OK;
+    }
+    spi_transaction_t *done = NULL;
+    ESP_RETURN_ON_ERROR(spi_device_get_trans_result(spi_strip->spi_device, &done, portMAX_DELAY), TAG, "wait for SPI transmission failed");
+    spi_strip->trans_pending = false;
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_spi_refresh(led_strip_t *strip)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    size_t buf_size = spi_strip->strip_len * spi_strip->bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE;
+    // the previous frame has been sent while this one was encoded, this usually returns at once
+    ESP_RETURN_ON_ERROR(led_strip_spi_wait_pending(spi_strip), TAG, "reap previous transmission failed");
+
+    spi_transaction_t *tx_conf = &spi_strip->trans;
+    memset(tx_conf, 0, sizeof(*tx_conf));
+    tx_conf->length = buf_size * 8;
+    tx_conf->tx_buffer = spi_strip->pixel_buf;
+    tx_conf->rx_buffer = NULL;
+    if (!spi_strip->async_refresh) {
+        ESP_RETURN_ON_ERROR(spi_device_transmit(spi_strip->spi_device, tx_conf), TAG, "transmit pixels by SPI failed");
+        return ESP_OK;
+    }
+
+    ESP_RETURN_ON_ERROR(spi_device_queue_trans(spi_strip->spi_device, tx_conf, portMAX_DELAY), TAG, "queue pixels by SPI failed");
+    spi_strip->trans_pending = true;
+    // further set_pixel calls go to the other buffer, which starts from the frame being sent
+    uint8_t *next = spi_strip->pixel_buf == spi_strip->pixel_storage ?
+                    spi_strip->pixel_storage + SPI_DMA_ALIGNED_SIZE(buf_size) : spi_strip->pixel_storage;
+    memcpy(next, spi_strip->pixel_buf, buf_size);
+    spi_strip->pixel_buf = next;
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_spi_clear(led_strip_t *strip)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    //Write zero to turn off all leds
+    memset(spi_strip->pixel_buf, 0, spi_strip->strip_len * spi_strip->bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE);
+    uint8_t *buf = spi_strip->pixel_buf;
+    for (int index = 0; index < spi_strip->strip_len * spi_strip->bytes_per_pixel; index++) {
+        __led_strip_spi_bit(0, buf);
+        buf += SPI_BYTES_PER_COLOR_BYTE;
+    }
+
+    return led_strip_spi_refresh(strip);
+}
+
+static esp_err_t led_strip_spi_del(led_strip_t *strip)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+
+    ESP_RETURN_ON_ERROR(led_strip_spi_wait_pending(spi_strip), TAG, "wait for SPI transmission failed");
+    ESP_RETURN_ON_ERROR(spi_bus_remove_device(spi_strip->spi_device), TAG, "delete spi device failed");
+    ESP_RETURN_ON_ERROR(spi_bus_free(spi_strip->spi_host), TAG, "free spi bus failed");
+
+    free(spi_strip->chunk_buf[0]);
+    free(spi_strip->chunk_buf[1]);
+    free(spi_strip);
+    return ESP_OK;
+}
+
+esp_err_t led_strip_new_spi_device(const led_strip_config_t *led_config, const led_strip_spi_config_t *spi_config, led_strip_handle_t *ret_strip)
+{
+    led_strip_spi_obj *spi_strip = NULL;
+    esp_err_t ret = ESP_OK;
+    ESP_GOTO_ON_FALSE(led_config && spi_config && ret_strip, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
+    ESP_GOTO_ON_FALSE(led_config->led_pixel_format < LED_PIXEL_FORMAT_INVALID, ESP_ERR_INVALID_ARG, err, TAG, "invalid led_pixel_format");
+    uint8_t bytes_per_pixel = 3;
+    if (led_config->led_pixel_format == LED_PIXEL_FORMAT_GRBW) {
+        bytes_per_pixel = 4;
+    } else if (led_config->led_pixel_format == LED_PIXEL_FORMAT_GRB) {
+        bytes_per_pixel = 3;
+    } else {
+        assert(false);
+    }
+    bool stream = spi_config->flags.stream;
+    ESP_GOTO_ON_FALSE(!(stream && spi_config->flags.async_refresh), ESP_ERR_INVALID_ARG, err, TAG, "stream and async_refresh are exclusive");
+    ESP_GOTO_ON_FALSE(!spi_config->pixel_buf || stream, ESP_ERR_INVALID_ARG, err, TAG, "pixel_buf needs the stream mode");
+    uint32_t mem_caps = MALLOC_CAP_DEFAULT;
+    if (spi_config->flags.with_dma) {
+        // DMA buffer must be placed in internal SRAM
+        mem_caps |= MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA;
+    }
+    size_t buf_size = led_config->max_leds * bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE;
+    size_t storage_size = SPI_DMA_ALIGNED_SIZE(buf_size) * (spi_config->flags.async_refresh ? 2 : 1);
+    size_t transfer_size = buf_size;
+    if (stream) {
+        // only the chunk buffers are sent, the raw pixels can live in any memory
+        storage_size = spi_config->pixel_buf ? 0 : led_config->max_leds * bytes_per_pixel;
+        transfer_size = (LED_STRIP_SPI_STREAM_CHUNK_SIZE / (bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE)) * bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE;
+        transfer_size = MIN(transfer_size, buf_size);
+    }
+    spi_strip = heap_caps_calloc(1, sizeof(led_strip_spi_obj) + storage_size, stream ? MALLOC_CAP_DEFAULT : mem_caps);
+
+    ESP_GOTO_ON_FALSE(spi_strip, ESP_ERR_NO_MEM, err, TAG, "no mem for spi strip");
+    spi_strip->pixel_buf = spi_config->pixel_buf ? spi_config->pixel_buf : spi_strip->pixel_storage;
+    spi_strip->async_refresh = spi_config->flags.async_refresh;
+    if (stream) {
+        spi_strip->chunk_color_bytes = transfer_size / SPI_BYTES_PER_COLOR_BYTE;
+        for (int chunk = 0; chunk < 2; chunk++) {
+            spi_strip->chunk_buf[chunk] = heap_caps_malloc(SPI_DMA_ALIGNED_SIZE(transfer_size), mem_caps);
+            ESP_GOTO_ON_FALSE(spi_strip->chunk_buf[chunk], ESP_ERR_NO_MEM, err, TAG, "no mem for spi chunk");
+        }
+        ESP_LOGD(TAG, "stream mode: %u bytes of DMA memory instead of %u",
+                 (unsigned)(2 * SPI_DMA_ALIGNED_SIZE(transfer_size)), (unsigned)buf_size);
+    }
+
+    spi_strip->spi_host = spi_config->spi_bus;
+    // for backward compatibility, if the user does not set the clk_src, use the default value
+    spi_clock_source_t clk_src = SPI_CLK_SRC_DEFAULT;
+    if (spi_config->clk_src) {
+        clk_src = spi_config->clk_src;
+    }
+
+    spi_bus_config_t spi_bus_cfg = {
+        .mosi_io_num = led_config->strip_gpio_num,
+        //Only use MOSI to generate the signal, set -1 when other pins are not used.
+        .miso_io_num = -1,
+        .sclk_io_num = -1,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = transfer_size,
+    };
+    ESP_GOTO_ON_ERROR(spi_bus_initialize(spi_strip->spi_host, &spi_bus_cfg, spi_config->flags.with_dma ? SPI_DMA_CH_AUTO : SPI_DMA_DISABLED), err, TAG, "create SPI bus failed");
+
+    if (led_config->flags.invert_out == true) {
+        esp_rom_gpio_connect_out_signal(led_config->strip_gpio_num, spi_periph_signal[spi_strip->spi_host].spid_out, true, false);
+    }
+
+    spi_device_interface_config_t spi_dev_cfg = {
+        .clock_source = clk_src,
+        .command_bits = 0,
+        .address_bits = 0,
+        .dummy_bits = 0,
+        .clock_speed_hz = LED_STRIP_SPI_DEFAULT_RESOLUTION,
+        .mode = 0,
+        //set -1 when CS is not used
+        .spics_io_num = -1,
+        .queue_size = LED_STRIP_SPI_DEFAULT_TRANS_QUEUE_SIZE,
+    };
+
+    ESP_GOTO_ON_ERROR(spi_bus_add_device(spi_strip->spi_host, &spi_dev_cfg, &spi_strip->spi_device), err, TAG, "Failed to add spi device");
+
+    int clock_resolution_khz = 0;
+    spi_device_get_actual_freq(spi_strip->spi_device, &clock_resolution_khz);
+    // TODO: ideally we should decide the SPI_BYTES_PER_COLOR_BYTE by the real clock resolution
+    // But now, let's fixed the resolution, the downside is, we don't support a clock source whose frequency is not multiple of LED_STRIP_SPI_DEFAULT_RESOLUTION
+    ESP_GOTO_ON_FALSE(clock_resolution_khz == LED_STRIP_SPI_DEFAULT_RESOLUTION / 1000, ESP_ERR_NOT_SUPPORTED, err,
+                      TAG, "unsupported clock resolution:%dKHz", clock_resolution_khz);
+
+    spi_strip->bytes_per_pixel = bytes_per_pixel;
+    spi_strip->strip_len = led_config->max_leds;
+    if (stream) {
+        spi_strip->base.set_pixel = led_strip_spi_stream_set_pixel;
+        spi_strip->base.set_pixel_rgbw = led_strip_spi_stream_set_pixel_rgbw;
+        spi_strip->base.refresh = led_strip_spi_stream_refresh;
+        spi_strip->base.clear = led_strip_spi_stream_clear;
+    } else {
+        spi_strip->base.set_pixel = led_strip_spi_set_pixel;
+        spi_strip->base.set_pixel_rgbw = led_strip_spi_set_pixel_rgbw;
+        spi_strip->base.refresh = led_strip_spi_refresh;
+        spi_strip->base.clear = led_strip_spi_clear;
+    }
+    spi_strip->base.del = led_strip_spi_del;
+
+    *ret_strip = &spi_strip->base;
+    return ESP_OK;
+err:
+    if (spi_strip) {
+        if (spi_strip->spi_device) {
+            spi_bus_remove_device(spi_strip->spi_device);
+        }
+        if (spi_strip->spi_host) {
+            spi_bus_free(spi_strip->spi_host);
+        }
+        free(spi_strip->chunk_buf[0]);
+        free(spi_strip->chunk_buf[1]);
+        free(spi_strip);
+    }
+    return ret;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "esp_err.h"
+
+// Host stand-in of the IDF header, for the tests of test_host/: the checks jump to
+// the error path without logging
+#define ESP_GOTO_ON_FALSE(a, err_code, goto_tag, log_tag, format, ...) \
+    do {                                                                \
+        (void)log_tag;                                                  \
+        if (!(a)) {                                                     \
+            ret = err_code;                                             \
+            goto goto_tag;                                              \
+        }                                                               \
+    } while (0)
+
+#define ESP_GOTO_ON_ERROR(x, goto_tag, log_tag, format, ...) \
+    do {                                                     \
+        (void)log_tag;                                       \
+        const esp_err_t err_rc_ = (x);                       \
+        if (err_rc_ != ESP_OK) {                             \
+            ret = err_rc_;                                   \
+            goto goto_tag;                                   \
+        }                                                    \
+    } while (0)
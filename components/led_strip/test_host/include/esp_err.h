@@ -0,0 +1,12 @@
+#pragma once
+
+// Host stand-in of the IDF header, for the tests of test_host/: the codes used by the
+// code under test, with the values of IDF
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
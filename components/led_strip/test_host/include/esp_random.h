@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stddef.h>
+
+// Host stand-in of the IDF header, for the tests of test_host/: the test that includes
+// it provides the function
+void esp_fill_random(void *buf, size_t len);
@@ -0,0 +1,184 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+// Host test of the record authentication of main/frame_auth.h: records sealed with
+// OpenSSL's AES-GCM the way a client does, see frame_auth.h, are opened with
+// frame_auth_open() on top of mbedtls. Every record of a session must open and give
+// the payload back; a changed payload, tag or additional data byte, a record of
+// another session, and a record whose counter is not the expected one, skipped or
+// replayed, must be refused, with the counter still in step for the next record.
+// Needs the mbedtls and OpenSSL development files. Build and run with make in this
+// directory.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/evp.h>
+
+#define CONFIG_TURBO_FRAME_AUTH 1
+#define CONFIG_TURBO_FRAME_AUTH_KEY "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+#include "frame_auth.h"
+
+#define TEST_RECORDS 50
+#define TEST_MAX_PAYLOAD 3000
+// Record types of the TCP record protocol
+#define TEST_RECORD_FRAME 'F'
+#define TEST_RECORD_PALETTE 'P'
+
+static int s_failures;
+
+void esp_fill_random(void *buf, size_t len)
+{
+    uint8_t *bytes = buf;
+    for (size_t i = 0; i < len; i++) {
+        bytes[i] = rand();
+    }
+}
+
+static void fail(const char *what, int record)
+{
+    if (s_failures++ < 5) {
+        printf("%s, record %d\n", what, record);
+    }
+}
+
+// The client side: AES-256-GCM under the key of the configuration, nonce made of the
+// session id and the big-endian record counter
+static void seal(const uint8_t session_id[FRAME_AUTH_SESSION_ID_SIZE], uint32_t counter,
+                 const uint8_t aad[FRAME_AUTH_AAD_SIZE], uint8_t *payload, size_t size, uint8_t tag[FRAME_AUTH_TAG_SIZE])
+{
+    static const uint8_t key[32] = {0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15,
+                                    16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31};
+    uint8_t nonce[FRAME_AUTH_NONCE_SIZE];
+    memcpy(nonce, session_id, FRAME_AUTH_SESSION_ID_SIZE);
+    nonce[FRAME_AUTH_SESSION_ID_SIZE] = counter >> 24;
+    nonce[FRAME_AUTH_SESSION_ID_SIZE + 1] = counter >> 16;
+    nonce[FRAME_AUTH_SESSION_ID_SIZE + 2] = counter >> 8;
+    nonce[FRAME_AUTH_SESSION_ID_SIZE + 3] = counter;
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    int len;
+    EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, NULL, NULL);
+    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, sizeof(nonce), NULL);
+    EVP_EncryptInit_ex(ctx, NULL, NULL, key, nonce);
+    EVP_EncryptUpdate(ctx, NULL, &len, aad, FRAME_AUTH_AAD_SIZE);
+    EVP_EncryptUpdate(ctx, payload, &len, payload, size);
+    EVP_EncryptFinal_ex(ctx, payload + len, &len);
+    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, FRAME_AUTH_TAG_SIZE, tag);
+    EVP_CIPHER_CTX_free(ctx);
+}
+
+typedef struct {
+    uint8_t aad[FRAME_AUTH_AAD_SIZE];
+    uint8_t plain[TEST_MAX_PAYLOAD];
+    uint8_t sealed[TEST_MAX_PAYLOAD];
+    uint8_t tag[FRAME_AUTH_TAG_SIZE];
+    size_t size;
+} test_record_t;
+
+// A frame or a palette of random content, sealed as record counter of the session
+static void make_record(test_record_t *record, const uint8_t *session_id, uint32_t counter)
+{
+    const int palette = rand() % 4 == 0;
+    record->aad[0] = palette ? TEST_RECORD_PALETTE : TEST_RECORD_FRAME;
+    record->aad[1] = rand() % 4;
+    record->size = palette ? 768 : 1 + rand() % TEST_MAX_PAYLOAD;
+    esp_fill_random(record->plain, record->size);
+    memcpy(record->sealed, record->plain, record->size);
+    seal(session_id, counter, record->aad, record->sealed, record->size, record->tag);
+}
+
+// Opens a copy of the record, as the receiver does in the frame buffer
+static bool open_record(frame_auth_t *auth, const test_record_t *record, uint8_t *buffer)
+{
+    memcpy(buffer, record->sealed, record->size);
+    return frame_auth_open(auth, buffer, record->size, record->aad, record->tag);
+}
+
+static void check_session(frame_auth_t *auth)
+{
+    uint8_t session_id[FRAME_AUTH_SESSION_ID_SIZE];
+    frame_auth_start_session(auth, session_id);
+    static test_record_t record;
+    static test_record_t previous;
+    static uint8_t buffer[TEST_MAX_PAYLOAD];
+    // The counter of the client, in step with the one of the receiver
+    uint32_t counter = 0;
+    for (int i = 0; i < TEST_RECORDS; i++) {
+        make_record(&record, session_id, counter++);
+        if (!open_record(auth, &record, buffer) || memcmp(buffer, record.plain, record.size) != 0) {
+            fail("a sealed record was not opened", i);
+        }
+        previous = record;
+        // Each attack uses one counter of the receiver, the client skips it as well
+        switch (i % 6) {
+        case 1: // Payload
+            make_record(&record, session_id, counter++);
+            record.sealed[rand() % record.size] ^= 1 << (rand() % 8);
+            if (open_record(auth, &record, buffer)) {
+                fail("a modified payload was accepted", i);
+            }
+            break;
+        case 2: // Tag
+            make_record(&record, session_id, counter++);
+            record.tag[rand() % FRAME_AUTH_TAG_SIZE] ^= 1 << (rand() % 8);
+            if (open_record(auth, &record, buffer)) {
+                fail("a modified tag was accepted", i);
+            }
+            break;
+        case 3: // Additional data: record type, then pixel format
+            make_record(&record, session_id, counter++);
+            record.aad[(i / 6) % 2] ^= 1;
+            if (open_record(auth, &record, buffer)) {
+                fail("a modified additional data byte was accepted", i);
+            }
+            break;
+        case 4: // A record sealed with the next counter, as if one had been dropped
+            make_record(&record, session_id, counter + 1);
+            if (open_record(auth, &record, buffer)) {
+                fail("a record with a skipped counter was accepted", i);
+            }
+            ++counter;
+            break;
+        case 5: // The last record opened, again
+            if (open_record(auth, &previous, buffer)) {
+                fail("a replayed record was accepted", i);
+            }
+            ++counter;
+            break;
+        }
+    }
+    // A record of another session, with the expected counter
+    uint8_t other_session[FRAME_AUTH_SESSION_ID_SIZE];
+    memcpy(other_session, session_id, sizeof(other_session));
+    other_session[0] ^= 0x80;
+    make_record(&record, other_session, counter++);
+    if (open_record(auth, &record, buffer)) {
+        fail("a record of another session was accepted", TEST_RECORDS);
+    }
+    // and the session goes on
+    make_record(&record, session_id, counter++);
+    if (!open_record(auth, &record, buffer) || memcmp(buffer, record.plain, record.size) != 0) {
+        fail("the counter is out of step after the refused records", TEST_RECORDS);
+    }
+}
+
+int main(void)
+{
+    srand(1);
+    frame_auth_t auth;
+    if (frame_auth_init(&auth) != ESP_OK) {
+        printf("FAILED: frame_auth_init\n");
+        return 1;
+    }
+    // Two sessions, the second one restarts the counter
+    check_session(&auth);
+    check_session(&auth);
+    mbedtls_gcm_free(&auth.gcm);
+    if (s_failures) {
+        printf("FAILED: %d mismatches\n", s_failures);
+        return 1;
+    }
+    printf("frame_auth opens the sealed records and refuses the modified ones\n");
+    return 0;
+}
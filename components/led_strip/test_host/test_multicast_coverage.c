@@ -0,0 +1,144 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+// Host test of the multicast receiver bookkeeping of main/multicast_coverage.h: the
+// covered ranges are compared with a byte map while random datagrams, duplicated,
+// overlapping and reordered, are added, and the sequence order is checked across the
+// 16-bit wrap. Build and run with make in this directory.
+#include <stdio.h>
+#include <stdlib.h>
+#include "multicast_coverage.h"
+
+#define TEST_RANDOM_ROUNDS 20000
+#define TEST_SEGMENT_SIZE 900
+
+static int s_failures;
+
+static void fail(const char* what, int round)
+{
+    if (s_failures++ < 5) {
+        printf("%s, round %d\n", what, round);
+    }
+}
+
+// The ranges are sorted, disjoint, not touching, and cover exactly the marked bytes
+static int coverage_matches(const multicast_coverage_t* coverage, const uint8_t* covered)
+{
+    uint32_t position = 0;
+    for (uint32_t i = 0; i < coverage->count; i++) {
+        const multicast_range_t range = coverage->ranges[i];
+        if (range.first >= range.last || (i > 0 && range.first <= coverage->ranges[i - 1].last)) {
+            return 0;
+        }
+        for (; position < range.first; position++) {
+            if (covered[position]) {
+                return 0;
+            }
+        }
+        for (; position < range.last; position++) {
+            if (!covered[position]) {
+                return 0;
+            }
+        }
+    }
+    for (; position < TEST_SEGMENT_SIZE; position++) {
+        if (covered[position]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Datagrams of random sizes at random offsets until the segment is covered
+static void check_random_cover(void)
+{
+    for (int round = 0; round < TEST_RANDOM_ROUNDS; round++) {
+        multicast_coverage_t coverage = {0};
+        uint8_t covered[TEST_SEGMENT_SIZE] = {0};
+        int complete = 0;
+        for (int datagram = 0; datagram < 1000 && !complete; datagram++) {
+            const uint32_t first = rand() % TEST_SEGMENT_SIZE;
+            const uint32_t size = 1 + rand() % 200;
+            const uint32_t last = first + size < TEST_SEGMENT_SIZE ? first + size : TEST_SEGMENT_SIZE;
+            const multicast_coverage_t before = coverage;
+            if (multicast_cover(&coverage, first, last)) {
+                for (uint32_t i = first; i < last; i++) {
+                    covered[i] = 1;
+                }
+            } else if (before.count != MULTICAST_MAX_RANGES || memcmp(&before, &coverage, sizeof(before)) != 0) {
+                fail("a refused range changed the coverage", round);
+                return;
+            }
+            if (!coverage_matches(&coverage, covered)) {
+                fail("ranges do not match the bytes received", round);
+                return;
+            }
+            complete = multicast_covered(&coverage, TEST_SEGMENT_SIZE);
+            if (complete != (memchr(covered, 0, sizeof(covered)) == NULL)) {
+                fail("completion does not match the bytes received", round);
+                return;
+            }
+        }
+    }
+}
+
+static void check_cases(void)
+{
+    multicast_coverage_t coverage = {0};
+    // Reordered halves, a duplicate, and touching ranges that merge
+    multicast_cover(&coverage, 450, 900);
+    multicast_cover(&coverage, 450, 900);
+    if (coverage.count != 1 || multicast_covered(&coverage, 900)) {
+        fail("second half alone", 0);
+    }
+    multicast_cover(&coverage, 0, 450);
+    if (!multicast_covered(&coverage, 900)) {
+        fail("touching halves do not complete the segment", 0);
+    }
+    // One range too many is refused
+    coverage.count = 0;
+    for (uint32_t i = 0; i < MULTICAST_MAX_RANGES; i++) {
+        multicast_cover(&coverage, i * 10, i * 10 + 5);
+    }
+    if (multicast_cover(&coverage, 200, 205) || coverage.count != MULTICAST_MAX_RANGES) {
+        fail("a range past MULTICAST_MAX_RANGES was accepted", 0);
+    }
+    // but a range bridging existing ones still fits
+    if (!multicast_cover(&coverage, 5, 10) || coverage.count != MULTICAST_MAX_RANGES - 1) {
+        fail("a bridging range was refused", 0);
+    }
+}
+
+static void check_sequence_age(void)
+{
+    const struct {
+        uint16_t current;
+        uint16_t sequence;
+        int16_t age;
+    } cases[] = {
+        {10, 10, 0}, {10, 9, 1}, {10, 11, -1}, {0, 65535, 1}, {65535, 0, -1}, {3, 65533, 6}, {65533, 3, -6},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const int16_t age = multicast_sequence_age(cases[i].current, cases[i].sequence);
+        if (age != cases[i].age && s_failures++ < 5) {
+            printf("sequence %u against %u: age %d, expected %d\n", cases[i].sequence, cases[i].current, age,
+                   cases[i].age);
+        }
+    }
+}
+
+int main(void)
+{
+    srand(1);
+    check_cases();
+    check_random_cover();
+    check_sequence_age();
+    if (s_failures) {
+        printf("FAILED: %d mismatches\n", s_failures);
+        return 1;
+    }
+    printf("multicast coverage and sequence order match the reference\n");
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+// Host test of the parallel backend encoding: the transpose kernel and the waveform of
+// 8 and 16 lanes are compared with a bit by bit reference on random colors, then the
+// encoding of a strip is timed. Build and run with make in this directory.
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "led_strip_parallel_encoder.h"
+
+#define TEST_RANDOM_ROUNDS 10000
+#define TEST_COLOR_BYTES 300
+// Untouched high and low slots of the waveform
+#define TEST_SENTINEL 0xA5
+#define BENCH_LEDS 1000
+#define BENCH_RUNS 200
+
+static int check_transpose8(void)
+{
+    int failures = 0;
+    for (int round = 0; round < TEST_RANDOM_ROUNDS; round++) {
+        uint8_t lanes[8];
+        uint8_t bits[8];
+        for (int lane = 0; lane < 8; lane++) {
+            lanes[lane] = rand();
+        }
+        __led_strip_parallel_transpose8(lanes, bits);
+        for (int j = 0; j < 8; j++) {
+            uint8_t expected = 0;
+            for (int lane = 0; lane < 8; lane++) {
+                expected |= ((lanes[lane] >> (7 - j)) & 1) << lane;
+            }
+            if (bits[j] != expected && failures++ < 5) {
+                printf("transpose8: bit %d is 0x%02x, expected 0x%02x\n", j, bits[j], expected);
+            }
+        }
+    }
+    return failures;
+}
+
+static int check_encode(uint32_t lanes)
+{
+    const uint32_t bus_bytes = lanes / 8;
+    const size_t wave_size = TEST_COLOR_BYTES * PARALLEL_SLOTS_PER_COLOR_BYTE * bus_bytes;
+    uint8_t *colors = malloc(TEST_COLOR_BYTES * lanes);
+    uint8_t *wave = malloc(wave_size);
+    for (size_t i = 0; i < TEST_COLOR_BYTES * lanes; i++) {
+        colors[i] = rand();
+    }
+    memset(wave, TEST_SENTINEL, wave_size);
+    __led_strip_parallel_encode(colors, TEST_COLOR_BYTES, lanes, wave);
+
+    int failures = 0;
+    for (uint32_t i = 0; i < TEST_COLOR_BYTES; i++) {
+        for (int bit = 0; bit < 8; bit++) {
+            const uint8_t *slots = wave + ((i * 8 + bit) * PARALLEL_SLOTS_PER_BIT) * bus_bytes;
+            for (uint32_t group = 0; group < bus_bytes; group++) {
+                uint8_t expected = 0;
+                for (int lane = 0; lane < 8; lane++) {
+                    expected |= ((colors[i * lanes + group * 8 + lane] >> (7 - bit)) & 1) << lane;
+                }
+                const uint8_t high = slots[group];
+                const uint8_t data = slots[bus_bytes + group];
+                const uint8_t low = slots[2 * bus_bytes + group];
+                if ((data != expected || high != TEST_SENTINEL || low != TEST_SENTINEL) && failures++ < 5) {
+                    printf("encode %u lanes: color byte %u bit %d group %u is %02x %02x %02x, expected data 0x%02x\n",
+                           (unsigned)lanes, (unsigned)i, bit, (unsigned)group, high, data, low, expected);
+                }
+            }
+        }
+    }
+    free(colors);
+    free(wave);
+    return failures;
+}
+
+static void bench_encode(uint32_t lanes)
+{
+    const uint32_t color_bytes = BENCH_LEDS * 3;
+    uint8_t *colors = calloc(color_bytes, lanes);
+    uint8_t *wave = calloc(color_bytes * PARALLEL_SLOTS_PER_COLOR_BYTE, lanes / 8);
+    for (size_t i = 0; i < color_bytes * lanes; i++) {
+        colors[i] = rand();
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        __led_strip_parallel_encode(colors, color_bytes, lanes, wave);
+        // Keeps the compiler from dropping the runs
+        __asm__ volatile("" : : "r"(wave) : "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double ns = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / BENCH_RUNS;
+    printf("encode %2u lanes x %d GRB LEDs: %.1f us per refresh, %.2f ns per LED\n",
+           (unsigned)lanes, BENCH_LEDS, ns / 1000, ns / (BENCH_LEDS * lanes));
+    free(colors);
+    free(wave);
+}
+
+int main(void)
+{
+    srand(1);
+    int failures = check_transpose8();
+    failures += check_encode(8);
+    failures += check_encode(16);
+    if (failures) {
+        printf("FAILED: %d mismatches\n", failures);
+        return 1;
+    }
+    printf("transpose8 and 8/16 lane encoding match the reference\n");
+    bench_encode(8);
+    bench_encode(16);
+    return 0;
+}
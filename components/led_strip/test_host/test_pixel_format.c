@@ -0,0 +1,208 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+// Host test of the frame formats of main/pixel_format.h and of the RGBW conversion of
+// main/rgbw.h: the expanders are compared with floating point references, the RGBW
+// split with its definition, then each kernel is timed per pixel. Build and run with
+// make in this directory.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pixel_format.h"
+#include "rgbw.h"
+
+#define TEST_RANDOM_ROUNDS 100000
+// Largest error of the HSV expansion against the float reference, in 8-bit steps
+#define TEST_HSV_TOLERANCE 3
+#define BENCH_LEDS 1000
+#define BENCH_RUNS 2000
+
+static int s_failures;
+
+static void check(int condition, const char* what, int a, int b, int c, const uint8_t out[3])
+{
+    if (!condition && s_failures++ < 5) {
+        printf("%s: input %d %d %d gives %d %d %d\n", what, a, b, c, out[0], out[1], out[2]);
+    }
+}
+
+static void check_rgb565(void)
+{
+    for (uint32_t packed = 0; packed < 0x10000; packed++) {
+        const uint8_t frame[2] = {packed & 0xFF, packed >> 8};
+        uint8_t rgb[3];
+        pixel_expand_rgb565(frame, 0, rgb);
+        const uint32_t fields[3] = {packed >> 11, (packed >> 5) & 0x3F, packed & 0x1F};
+        const uint32_t maxima[3] = {31, 63, 31};
+        for (int c = 0; c < 3; c++) {
+            const double expected = fields[c] * 255.0 / maxima[c];
+            check(fabs(rgb[c] - expected) < 1.0, "rgb565", fields[0], fields[1], fields[2], rgb);
+        }
+    }
+}
+
+static void check_palette8(void)
+{
+    pixel_palette_t palette;
+    for (int i = 0; i < PIXEL_PALETTE_ENTRIES; i++) {
+        palette[i][0] = i;
+        palette[i][1] = 255 - i;
+        palette[i][2] = i * 7;
+    }
+    // The second pixel of the frame, to check the indexing
+    for (int i = 0; i < PIXEL_PALETTE_ENTRIES; i++) {
+        const uint8_t frame[2] = {0, i};
+        uint8_t rgb[3];
+        pixel_expand_palette8(frame, 1, palette, rgb);
+        check(memcmp(rgb, palette[i], 3) == 0, "palette8", i, 0, 0, rgb);
+    }
+}
+
+// Textbook HSV to RGB, hue in 1/256 of a turn
+static void reference_hsv(int hue, int saturation, int value, double rgb[3])
+{
+    const double h = hue * 6.0 / 256.0;
+    const double s = saturation / 255.0;
+    const double v = value / 255.0;
+    const double f = h - floor(h);
+    const double p = v * (1 - s);
+    const double q = v * (1 - s * f);
+    const double t = v * (1 - s * (1 - f));
+    const double sectors[6][3] = {{v, t, p}, {q, v, p}, {p, v, t}, {p, q, v}, {t, p, v}, {v, p, q}};
+    for (int c = 0; c < 3; c++) {
+        rgb[c] = sectors[(int)h][c] * 255.0;
+    }
+}
+
+static void check_hsv(void)
+{
+    for (int hue = 0; hue < 256; hue++) {
+        for (int saturation = 0; saturation < 256; saturation += 5) {
+            for (int value = 0; value < 256; value += 5) {
+                const uint8_t frame[3] = {hue, saturation, value};
+                uint8_t rgb[3];
+                pixel_expand_hsv(frame, 0, rgb);
+                double expected[3];
+                reference_hsv(hue, saturation, value, expected);
+                for (int c = 0; c < 3; c++) {
+                    check(fabs(rgb[c] - expected[c]) <= TEST_HSV_TOLERANCE, "hsv", hue, saturation, value, rgb);
+                }
+                // Gray and black are exact
+                if (saturation == 0) {
+                    check(rgb[0] == value && rgb[1] == value && rgb[2] == value, "hsv gray", hue, saturation, value, rgb);
+                }
+            }
+        }
+    }
+}
+
+// The white channel is min(rgb[c] * 255 / white_point[c]), one step lower at most from
+// the 16.16 inverse of the white point, and the color minus the white point scaled by
+// it gives back the RGB channels
+static void check_rgbw(const uint8_t white_point[3], const char* name)
+{
+    rgbw_converter_t converter;
+    rgbw_converter_init(&converter, white_point);
+    for (int round = 0; round < TEST_RANDOM_ROUNDS; round++) {
+        const uint8_t rgb[3] = {rand(), rand(), rand()};
+        uint8_t grbw[4];
+        rgbw_convert(&converter, rgb, grbw);
+        const uint8_t out[3] = {grbw[1], grbw[0], grbw[2]};
+        const uint32_t white = grbw[3];
+        uint32_t expected_white = 255;
+        int fits = 1;
+        for (int c = 0; c < 3; c++) {
+            const uint32_t candidate = rgb[c] * 255u / white_point[c];
+            expected_white = candidate < expected_white ? candidate : expected_white;
+            const uint32_t removed = white * white_point[c] / 255;
+            fits &= removed <= rgb[c] && out[c] + removed == rgb[c];
+        }
+        check(fits && white <= expected_white && white + 1 >= expected_white, name, rgb[0], rgb[1], rgb[2], grbw);
+    }
+    // Neutral white point: plain min(R, G, B) extraction
+    if (white_point == RGBW_WHITE_POINT_NEUTRAL) {
+        const uint8_t rgb[3] = {200, 120, 250};
+        uint8_t grbw[4];
+        rgbw_convert(&converter, rgb, grbw);
+        check(grbw[0] == 0 && grbw[1] == 80 && grbw[2] == 130 && grbw[3] == 120, name, 200, 120, 250, grbw);
+    }
+}
+
+typedef void (*bench_kernel_t)(const uint8_t* frame, uint32_t index, uint8_t* out);
+
+static pixel_palette_t s_bench_palette;
+static rgbw_converter_t s_bench_converter;
+
+static void bench_rgb565(const uint8_t* frame, uint32_t index, uint8_t* out)
+{
+    pixel_expand_rgb565(frame, index, out);
+}
+
+static void bench_palette8(const uint8_t* frame, uint32_t index, uint8_t* out)
+{
+    pixel_expand_palette8(frame, index, s_bench_palette, out);
+}
+
+static void bench_hsv(const uint8_t* frame, uint32_t index, uint8_t* out)
+{
+    pixel_expand_hsv(frame, index, out);
+}
+
+static void bench_rgbw(const uint8_t* frame, uint32_t index, uint8_t* out)
+{
+    rgbw_convert(&s_bench_converter, frame + 3 * index, out);
+}
+
+// Each kernel writes 4 bytes per pixel at most, the frame holds 3 bytes per pixel at most
+static void bench(const char* name, bench_kernel_t kernel, const uint8_t* frame, uint8_t* out)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        for (uint32_t i = 0; i < BENCH_LEDS; i++) {
+            kernel(frame, i, out + 4 * i);
+        }
+        // Keeps the compiler from dropping the runs
+        __asm__ volatile("" : : "r"(out) : "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double ns = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / BENCH_RUNS;
+    printf("%-9s x %d LEDs: %.1f us per frame, %.2f ns per LED\n", name, BENCH_LEDS, ns / 1000, ns / BENCH_LEDS);
+}
+
+int main(void)
+{
+    srand(1);
+    pixel_format_init();
+    check_rgb565();
+    check_palette8();
+    check_hsv();
+    check_rgbw(RGBW_WHITE_POINT_NEUTRAL, "rgbw neutral");
+    check_rgbw(RGBW_WHITE_POINT_WARM, "rgbw warm");
+    if (s_failures) {
+        printf("FAILED: %d mismatches\n", s_failures);
+        return 1;
+    }
+    printf("rgb565, palette8, hsv and rgbw match the reference\n");
+
+    uint8_t* frame = malloc(BENCH_LEDS * 3);
+    uint8_t* out = malloc(BENCH_LEDS * 4);
+    for (size_t i = 0; i < BENCH_LEDS * 3; i++) {
+        frame[i] = rand();
+    }
+    for (int i = 0; i < PIXEL_PALETTE_ENTRIES; i++) {
+        s_bench_palette[i][0] = s_bench_palette[i][1] = s_bench_palette[i][2] = i;
+    }
+    rgbw_converter_init(&s_bench_converter, RGBW_WHITE_POINT_WARM);
+    bench("rgb565", bench_rgb565, frame, out);
+    bench("palette8", bench_palette8, frame, out);
+    bench("hsv", bench_hsv, frame, out);
+    bench("rgbw", bench_rgbw, frame, out);
+    free(frame);
+    free(out);
+    return 0;
+}
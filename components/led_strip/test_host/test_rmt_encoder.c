@@ -0,0 +1,244 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+// Host test of the RMT backend encoding: src/led_strip_rmt_encoder.c is built against
+// host models of the IDF bytes and copy encoders, which write one symbol per bit into a
+// channel memory block and yield when it is full, and of the transmit loop, which
+// drains the block and calls the encoder again. The symbols sent for random strips
+// are compared with the WS2812 and SK6812 timings followed by the reset code, then
+// the encoding of a strip is timed. The time covers rmt_encode_led_strip() and the
+// models, not the IDF encoders on the chip. Build and run with make in this directory.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "led_strip_rmt_encoder.h"
+
+#define TEST_RESOLUTION_HZ (10 * 1000 * 1000)
+#define TEST_RANDOM_ROUNDS 2000
+#define TEST_MAX_BYTES 400
+// Ping-pong half of a channel of 64 symbols, and a size that splits the bytes
+static const size_t TEST_MEM_SYMBOLS[] = {32, 45};
+#define BENCH_LEDS 1000
+#define BENCH_RUNS 200
+#define BENCH_MEM_SYMBOLS 32
+
+// Channel memory block, drained into a record of the symbols sent
+struct rmt_channel_t {
+    rmt_symbol_word_t mem[64];
+    size_t mem_size;
+    size_t mem_offset;
+    rmt_symbol_word_t *sent;
+    size_t sent_count;
+    size_t sent_capacity;
+};
+
+typedef struct {
+    rmt_encoder_t base;
+    rmt_symbol_word_t bit0;
+    rmt_symbol_word_t bit1;
+    bool msb_first;
+    size_t index; // bit index in the data for the bytes encoder, symbol index for the copy encoder
+} host_encoder_t;
+
+// One symbol per bit, until the data is done or the block is full, then both flags as IDF
+static size_t host_encode_bytes(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data,
+                                size_t data_size, rmt_encode_state_t *ret_state)
+{
+    host_encoder_t *bytes = __containerof(encoder, host_encoder_t, base);
+    const uint8_t *data = primary_data;
+    size_t encoded = 0;
+    rmt_encode_state_t state = 0;
+    while (bytes->index < data_size * 8 && channel->mem_offset < channel->mem_size) {
+        const size_t bit = bytes->msb_first ? 7 - bytes->index % 8 : bytes->index % 8;
+        channel->mem[channel->mem_offset++] = (data[bytes->index / 8] >> bit) & 1 ? bytes->bit1 : bytes->bit0;
+        ++bytes->index;
+        ++encoded;
+    }
+    if (bytes->index == data_size * 8) {
+        bytes->index = 0;
+        state |= RMT_ENCODING_COMPLETE;
+    }
+    if (channel->mem_offset == channel->mem_size) {
+        state |= RMT_ENCODING_MEM_FULL;
+    }
+    *ret_state = state;
+    return encoded;
+}
+
+static size_t host_encode_copy(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data,
+                               size_t data_size, rmt_encode_state_t *ret_state)
+{
+    host_encoder_t *copy = __containerof(encoder, host_encoder_t, base);
+    const rmt_symbol_word_t *symbols = primary_data;
+    const size_t count = data_size / sizeof(rmt_symbol_word_t);
+    size_t encoded = 0;
+    rmt_encode_state_t state = 0;
+    while (copy->index < count && channel->mem_offset < channel->mem_size) {
+        channel->mem[channel->mem_offset++] = symbols[copy->index++];
+        ++encoded;
+    }
+    if (copy->index == count) {
+        copy->index = 0;
+        state |= RMT_ENCODING_COMPLETE;
+    }
+    if (channel->mem_offset == channel->mem_size) {
+        state |= RMT_ENCODING_MEM_FULL;
+    }
+    *ret_state = state;
+    return encoded;
+}
+
+static esp_err_t host_encoder_reset(rmt_encoder_t *encoder)
+{
+    __containerof(encoder, host_encoder_t, base)->index = 0;
+    return ESP_OK;
+}
+
+static esp_err_t host_encoder_del(rmt_encoder_t *encoder)
+{
+    free(__containerof(encoder, host_encoder_t, base));
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_bytes_encoder(const rmt_bytes_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    host_encoder_t *bytes = calloc(1, sizeof(host_encoder_t));
+    bytes->base = (rmt_encoder_t) {.encode = host_encode_bytes, .reset = host_encoder_reset, .del = host_encoder_del};
+    bytes->bit0 = config->bit0;
+    bytes->bit1 = config->bit1;
+    bytes->msb_first = config->flags.msb_first;
+    *ret_encoder = &bytes->base;
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_copy_encoder(const rmt_copy_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    (void)config;
+    host_encoder_t *copy = calloc(1, sizeof(host_encoder_t));
+    copy->base = (rmt_encoder_t) {.encode = host_encode_copy, .reset = host_encoder_reset, .del = host_encoder_del};
+    *ret_encoder = &copy->base;
+    return ESP_OK;
+}
+
+esp_err_t rmt_del_encoder(rmt_encoder_handle_t encoder)
+{
+    return encoder->del(encoder);
+}
+
+esp_err_t rmt_encoder_reset(rmt_encoder_handle_t encoder)
+{
+    return encoder->reset(encoder);
+}
+
+static void host_drain(rmt_channel_handle_t channel)
+{
+    if (channel->sent_count + channel->mem_offset <= channel->sent_capacity) {
+        memcpy(channel->sent + channel->sent_count, channel->mem, channel->mem_offset * sizeof(rmt_symbol_word_t));
+    }
+    channel->sent_count += channel->mem_offset;
+    channel->mem_offset = 0;
+}
+
+// The transmit loop of the driver: encode, drain the block when full, until complete
+static void host_transmit(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const uint8_t *data, size_t size)
+{
+    channel->sent_count = 0;
+    channel->mem_offset = 0;
+    rmt_encode_state_t state;
+    do {
+        state = 0;
+        encoder->encode(encoder, channel, data, size, &state);
+        if (state & RMT_ENCODING_MEM_FULL) {
+            host_drain(channel);
+        }
+    } while (!(state & RMT_ENCODING_COMPLETE));
+    host_drain(channel);
+}
+
+static bool symbol_is(rmt_symbol_word_t symbol, int level0, int duration0, int level1, int duration1)
+{
+    return symbol.level0 == level0 && symbol.duration0 == duration0 && symbol.level1 == level1 &&
+           symbol.duration1 == duration1;
+}
+
+// Durations in ticks of 100 ns: T0H, T0L, T1H, T1L
+static int check_model(led_model_t model, const char *name, const int timing[4])
+{
+    const led_strip_encoder_config_t config = {.resolution = TEST_RESOLUTION_HZ, .led_model = model};
+    rmt_encoder_handle_t encoder;
+    if (rmt_new_led_strip_encoder(&config, &encoder) != ESP_OK) {
+        printf("%s: no encoder\n", name);
+        return 1;
+    }
+    struct rmt_channel_t channel = {.sent_capacity = TEST_MAX_BYTES * 8 + 1};
+    channel.sent = malloc(channel.sent_capacity * sizeof(rmt_symbol_word_t));
+    uint8_t data[TEST_MAX_BYTES];
+    int failures = 0;
+    for (int round = 0; round < TEST_RANDOM_ROUNDS; round++) {
+        channel.mem_size = TEST_MEM_SYMBOLS[round % 2];
+        const size_t size = 1 + rand() % TEST_MAX_BYTES;
+        for (size_t i = 0; i < size; i++) {
+            data[i] = rand();
+        }
+        // The encoder is used again for each strip, as by led_strip_refresh()
+        host_transmit(encoder, &channel, data, size);
+        bool match = channel.sent_count == size * 8 + 1;
+        for (size_t i = 0; match && i < size * 8; i++) {
+            const int bit = (data[i / 8] >> (7 - i % 8)) & 1;
+            match = symbol_is(channel.sent[i], 1, timing[2 * bit], 0, timing[2 * bit + 1]);
+        }
+        match = match && symbol_is(channel.sent[size * 8], 0, 250, 0, 250);
+        if (!match && failures++ < 5) {
+            printf("%s: %zu bytes, block of %zu symbols: %zu symbols sent, or wrong ones\n", name, size,
+                   channel.mem_size, channel.sent_count);
+        }
+    }
+    free(channel.sent);
+    rmt_del_encoder(encoder);
+    return failures;
+}
+
+static void bench_encode(void)
+{
+    const led_strip_encoder_config_t config = {.resolution = TEST_RESOLUTION_HZ, .led_model = LED_MODEL_WS2812};
+    rmt_encoder_handle_t encoder;
+    rmt_new_led_strip_encoder(&config, &encoder);
+    const size_t size = BENCH_LEDS * 3;
+    uint8_t *data = malloc(size);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = rand();
+    }
+    // Nothing is recorded: the blocks are only drained, as by the hardware
+    struct rmt_channel_t channel = {.mem_size = BENCH_MEM_SYMBOLS};
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        host_transmit(encoder, &channel, data, size);
+        __asm__ volatile("" : : "r"(&channel) : "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double ns = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / BENCH_RUNS;
+    printf("rmt encode x %d LEDs, blocks of %d symbols: %.1f us per frame, %.2f ns per LED\n", BENCH_LEDS,
+           BENCH_MEM_SYMBOLS, ns / 1000, ns / BENCH_LEDS);
+    free(data);
+    rmt_del_encoder(encoder);
+}
+
+int main(void)
+{
+    srand(1);
+    static const int WS2812[4] = {3, 9, 9, 3};
+    static const int SK6812[4] = {3, 9, 6, 6};
+    const int failures = check_model(LED_MODEL_WS2812, "ws2812", WS2812) + check_model(LED_MODEL_SK6812, "sk6812", SK6812);
+    if (failures) {
+        printf("FAILED: %d mismatches\n", failures);
+        return 1;
+    }
+    printf("rmt encoding matches the reference\n");
+    bench_encode();
+    return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+// Host test of the SPI backend encoding: the 3 SPI bits of each color bit are compared
+// with the 100/110 waveform for every byte value, then the encoding of a strip is timed
+// the way set_pixel and the streaming chunks do it. Build and run with make in this
+// directory.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "led_strip_spi_encoder.h"
+
+// Untouched bytes around the encoded ones
+#define TEST_SENTINEL 0xA5
+#define BENCH_LEDS 1000
+#define BENCH_RUNS 2000
+
+static int check_spi_bit(void)
+{
+    int failures = 0;
+    for (int data = 0; data < 256; data++) {
+        uint8_t buf[SPI_BYTES_PER_COLOR_BYTE + 2] = {TEST_SENTINEL, 0, 0, 0, TEST_SENTINEL};
+        __led_strip_spi_bit(data, buf + 1);
+        // MSB first on the wire, and the SPI bytes MSB first too
+        uint32_t expected = 0;
+        for (int bit = 7; bit >= 0; bit--) {
+            expected = (expected << 3) | 0x4 | (((data >> bit) & 1) << 1);
+        }
+        const uint32_t encoded = (uint32_t)buf[1] << 16 | buf[2] << 8 | buf[3];
+        if ((encoded != expected || buf[0] != TEST_SENTINEL || buf[4] != TEST_SENTINEL) && failures++ < 5) {
+            printf("spi_bit: 0x%02x gives 0x%06x, expected 0x%06x\n", data, (unsigned)encoded, (unsigned)expected);
+        }
+    }
+    return failures;
+}
+
+// set_pixel of a GRB strip: clear the 9 SPI bytes of the pixel, then encode its colors
+static void bench_encode(void)
+{
+    const uint32_t color_bytes = BENCH_LEDS * 3;
+    uint8_t *colors = malloc(color_bytes);
+    uint8_t *buf = malloc(color_bytes * SPI_BYTES_PER_COLOR_BYTE);
+    for (uint32_t i = 0; i < color_bytes; i++) {
+        colors[i] = rand();
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        for (uint32_t led = 0; led < BENCH_LEDS; led++) {
+            uint8_t *pixel = buf + led * 3 * SPI_BYTES_PER_COLOR_BYTE;
+            memset(pixel, 0, 3 * SPI_BYTES_PER_COLOR_BYTE);
+            for (int c = 0; c < 3; c++) {
+                __led_strip_spi_bit(colors[led * 3 + c], pixel + c * SPI_BYTES_PER_COLOR_BYTE);
+            }
+        }
+        // Keeps the compiler from dropping the runs
+        __asm__ volatile("" : : "r"(buf) : "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double ns = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / BENCH_RUNS;
+    printf("spi encode x %d LEDs: %.1f us per frame, %.2f ns per LED\n", BENCH_LEDS, ns / 1000, ns / BENCH_LEDS);
+    free(colors);
+    free(buf);
+}
+
+int main(void)
+{
+    srand(1);
+    const int failures = check_spi_bit();
+    if (failures) {
+        printf("FAILED: %d mismatches\n", failures);
+        return 1;
+    }
+    printf("spi encoding matches the reference\n");
+    bench_encode();
+    return 0;
+}
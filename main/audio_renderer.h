@@ -0,0 +1,43 @@
+#include <stdint.h>
+#include "ledstrip_pipeline.h"
+
+// Base color of each band, from the lowest frequencies (red) to the highest (violet)
+static const uint8_t AUDIO_BAND_COLORS[AUDIO_MAX_BANDS][3] = {
+    {255, 0, 0},   {255, 48, 0},  {255, 96, 0},  {255, 160, 0},
+    {255, 224, 0}, {192, 255, 0}, {96, 255, 0},  {0, 255, 32},
+    {0, 255, 128}, {0, 255, 224}, {0, 192, 255}, {0, 96, 255},
+    {0, 0, 255},   {96, 0, 255},  {160, 0, 255}, {224, 0, 255},
+};
+// White added to every pixel on a beat, decays on each following message
+static const uint8_t AUDIO_BEAT_FLASH = 96;
+
+static uint8_t s_audio_beat_level = 0;
+
+// Stores the color of a physical LED in the pixel buffer
+typedef void (*audio_pixel_writer_t)(uint32_t index, uint8_t red, uint8_t green, uint8_t blue);
+
+// Splits the strip into one segment per band and lights each segment with the band
+// color scaled by the band energy. Beats add a decaying white flash on top.
+static void audio_render(audio_pixel_writer_t write_pixel, uint32_t led_count, const audio_features_t* features)
+{
+    if (features->beat) {
+        s_audio_beat_level = AUDIO_BEAT_FLASH;
+    } else {
+        s_audio_beat_level = s_audio_beat_level * 3 / 4;
+    }
+
+    const uint32_t band_count = features->band_count;
+    for (uint32_t i = 0; i < led_count; ++i) {
+        uint32_t r = s_audio_beat_level;
+        uint32_t g = s_audio_beat_level;
+        uint32_t b = s_audio_beat_level;
+        if (band_count != 0) {
+            const uint32_t band = i * band_count / led_count;
+            const uint32_t energy = features->bands[band];
+            r += AUDIO_BAND_COLORS[band][0] * energy / 255;
+            g += AUDIO_BAND_COLORS[band][1] * energy / 255;
+            b += AUDIO_BAND_COLORS[band][2] * energy / 255;
+        }
+        write_pixel(i, r > 255 ? 255 : r, g > 255 ? 255 : g, b > 255 ? 255 : b);
+    }
+}
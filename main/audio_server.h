@@ -0,0 +1,81 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/err.h"
+#include "lwip/sockets.h"
+#include "ledstrip_pipeline.h"
+
+static const char *TAG_AUDIO = "audio_server";
+
+// Audio features datagram, as sent by the TurboAudio analyzer:
+//   byte 0: protocol version (AUDIO_PACKET_VERSION)
+//   byte 1: flags, bit 0 set on a beat onset
+//   byte 2: number of band energies that follow (at most AUDIO_MAX_BANDS)
+//   byte 3..: one energy byte per band, lowest frequency first
+static const uint8_t AUDIO_PACKET_VERSION = 1;
+static const uint8_t AUDIO_PACKET_FLAG_BEAT = 1 << 0;
+static const int AUDIO_PACKET_HEADER_SIZE = 3;
+
+static bool parse_audio_packet(const uint8_t* packet, int len, audio_features_t* features)
+{
+    if (len < AUDIO_PACKET_HEADER_SIZE || packet[0] != AUDIO_PACKET_VERSION) {
+        return false;
+    }
+
+    const uint8_t band_count = packet[2];
+    if (band_count > AUDIO_MAX_BANDS || len < AUDIO_PACKET_HEADER_SIZE + band_count) {
+        return false;
+    }
+
+    features->beat = packet[1] & AUDIO_PACKET_FLAG_BEAT;
+    features->band_count = band_count;
+    memcpy(features->bands, packet + AUDIO_PACKET_HEADER_SIZE, band_count);
+    return true;
+}
+
+static void audio_server_task(void *pvParameters)
+{
+    static const uint32_t port = 1235;
+    ledstrip_pipeline_t* pipeline = (ledstrip_pipeline_t*) pvParameters;
+    struct sockaddr_in dest_addr = {
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+    };
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(TAG_AUDIO, "Unable to create socket: errno %d", errno);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    int err = bind(sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+    if (err != 0) {
+        ESP_LOGE(TAG_AUDIO, "Socket unable to bind: errno %d", errno);
+        close(sock);
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(TAG_AUDIO, "Socket bound, port %" PRIu32, port);
+
+    uint8_t rx_buffer[64];
+    while (true) {
+        int len = recv(sock, rx_buffer, sizeof(rx_buffer), 0);
+        if (len < 0) {
+            ESP_LOGE(TAG_AUDIO, "Error occurred during receiving: errno %d", errno);
+            continue;
+        }
+
+        ledstrip_message_t message = {
+            .type = LEDSTRIP_MESSAGE_AUDIO,
+            .received_us = esp_timer_get_time(),
+        };
+        if (!parse_audio_packet(rx_buffer, len, &message.audio)) {
+            ESP_LOGW(TAG_AUDIO, "Dropping malformed packet of %d bytes", len);
+            continue;
+        }
+        // Audio features are only meaningful when fresh: never wait for the consumer
+        xQueueSend(pipeline->messages, &message, 0);
+    }
+}
@@ -0,0 +1,347 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_app_desc.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_rom_sys.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "frame_auth.h"
+
+// Kernel benchmarks, enabled by CONFIG_TURBO_BENCHMARK, included after ledstrip_manager.h
+// whose kernels they time. Run at boot, before the LED task takes the strip GPIO and
+// bus, on the core of app_main. Each kernel runs BENCHMARK_WARMUP_RUNS times untimed,
+// which fills the caches and settles the driver, then BENCHMARK_SAMPLES times timed
+// with the cycle counter of the core.
+//
+// Results are printed on the console, one line per kernel and size, as "BENCH "
+// followed by a JSON object, so that they can be grepped out of a boot log and
+// compared between builds:
+//   {"type":"info", ...}: firmware and IDF versions, backend, CPU frequency
+//   {"type":"result","kernel":..., "format":..., "leds":..., cycle statistics per
+//    run, "cycles_per_pixel", "ns_per_pixel" and "runs_per_s" from the median}
+// Kernels:
+//   set_pixel:  led_strip_set_pixel() / led_strip_set_pixel_rgbw() over the strip,
+//               the encoding of the SPI and parallel backends
+//   refresh:    led_strip_refresh(), encoding of the other backends and wire time. The
+//               strip is dark: its pixels are all zero, which costs the same encoding
+//               and wire time as any other color and keeps a real strip within the
+//               power budget, which led_strip_refresh() alone does not apply
+//   refresh_cpu: the cycles of the core within refresh that are not wire time: the
+//               encoding of the RMT backend in its interrupt or of the SPI streaming
+//               chunks, the driver and the task switches. A spinning task of lower
+//               priority on the same core counts the cycles it gets while the refresh
+//               waits, refresh_cpu is the rest
+//   show_frame: frame conversion into the pixel buffer, for each frame format
+//   frame_crc:  ROM CRC-32 of a frame, the per-byte work of CONFIG_TURBO_FRAME_CRC
+//   frame_auth: AES-GCM decryption of a frame in place, CONFIG_TURBO_FRAME_AUTH. Its
+//               runs_per_s is the frame rate the decryption alone can sustain
+//   trace_record: trace_record() of CONFIG_TURBO_TRACE, "leds" events in a row, so
+//               that cycles_per_pixel is the cost of one event
+// The strip sizes that the driver cannot allocate are reported as skipped.
+#if CONFIG_TURBO_BENCHMARK
+static const char *TAG_BENCHMARK = "benchmark";
+#define BENCHMARK_WARMUP_RUNS 2
+#define BENCHMARK_SAMPLES 16
+static const uint32_t BENCHMARK_LED_COUNTS[] = {300, 1000, 5000};
+// Written by the CRC kernel so that the call is not optimized out
+static volatile uint32_t s_benchmark_crc;
+// Longest pass of the spinning loop of refresh_cpu, a longer gap between two passes is
+// time taken by an interrupt or another task
+#define BENCHMARK_SPIN_GAP_CYCLES 100
+
+// Shared with the spinning task of refresh_cpu
+typedef struct {
+    TaskHandle_t caller;
+    volatile bool active;
+    uint32_t own_cycles;
+} benchmark_spinner_t;
+
+static benchmark_spinner_t s_benchmark_spinner;
+
+typedef struct {
+    const char* kernel;
+    const char* format;
+    uint32_t leds;
+    uint32_t cycles[BENCHMARK_SAMPLES];
+} benchmark_result_t;
+
+typedef struct {
+    led_strip_handle_t strip;
+    bool rgbw;
+    const uint8_t* frame;
+    pixel_format_t pixel_format;
+#if CONFIG_TURBO_FRAME_AUTH
+    frame_auth_t* auth;
+#endif
+} benchmark_context_t;
+
+typedef void (*benchmark_kernel_t)(const benchmark_context_t* context, uint32_t leds);
+
+static void benchmark_set_pixels(const benchmark_context_t* context, uint32_t leds)
+{
+    for (uint32_t i = 0; i < leds; ++i) {
+        if (context->rgbw) {
+            led_strip_set_pixel_rgbw(context->strip, i, i, i >> 1, i >> 2, i >> 3);
+        } else {
+            led_strip_set_pixel(context->strip, i, i, i >> 1, i >> 2);
+        }
+    }
+}
+
+static void benchmark_blank_pixels(const benchmark_context_t* context, uint32_t leds)
+{
+    for (uint32_t i = 0; i < leds; ++i) {
+        if (context->rgbw) {
+            led_strip_set_pixel_rgbw(context->strip, i, 0, 0, 0, 0);
+        } else {
+            led_strip_set_pixel(context->strip, i, 0, 0, 0);
+        }
+    }
+}
+
+static void benchmark_refresh(const benchmark_context_t* context, uint32_t leds)
+{
+    led_strip_refresh(context->strip);
+}
+
+static void benchmark_show_frame(const benchmark_context_t* context, uint32_t leds)
+{
+    show_frame(context->frame, context->pixel_format);
+}
+
+static void benchmark_frame_crc(const benchmark_context_t* context, uint32_t leds)
+{
+    const uint32_t bytes = leds * (context->rgbw ? 4 : 3);
+    s_benchmark_crc = esp_rom_crc32_le(0, context->frame, bytes);
+}
+
+#if CONFIG_TURBO_FRAME_AUTH
+static void benchmark_frame_auth(const benchmark_context_t* context, uint32_t leds)
+{
+    const uint32_t bytes = leds * (context->rgbw ? 4 : 3);
+    static const uint8_t nonce[FRAME_AUTH_NONCE_SIZE] = {0};
+    static const uint8_t aad[FRAME_AUTH_AAD_SIZE] = {TCP_RECORD_FRAME, PIXEL_FORMAT_NATIVE};
+    uint8_t tag[FRAME_AUTH_TAG_SIZE];
+    // The work of frame_auth_open() without its tag comparison, which would fail on
+    // random data and wipe the buffer. Decrypting twice gives the frame back.
+    mbedtls_gcm_crypt_and_tag(&context->auth->gcm, MBEDTLS_GCM_DECRYPT, bytes, nonce, sizeof(nonce), aad, sizeof(aad),
+                              context->frame, (uint8_t*) context->frame, sizeof(tag), tag);
+}
+#endif
+
+#if CONFIG_TURBO_TRACE
+static void benchmark_trace_record(const benchmark_context_t* context, uint32_t leds)
+{
+    for (uint32_t i = 0; i < leds; ++i) {
+        trace_record(TRACE_SHOW_FRAME, TRACE_PHASE_INSTANT, i);
+    }
+}
+#endif
+
+static void benchmark_run_kernel(benchmark_kernel_t kernel, const benchmark_context_t* context, benchmark_result_t* result)
+{
+    for (int i = 0; i < BENCHMARK_WARMUP_RUNS; ++i) {
+        kernel(context, result->leds);
+    }
+    for (int i = 0; i < BENCHMARK_SAMPLES; ++i) {
+        const uint32_t start = esp_cpu_get_cycle_count();
+        kernel(context, result->leds);
+        result->cycles[i] = esp_cpu_get_cycle_count() - start;
+    }
+}
+
+// Only runs while the benchmark task waits for a refresh, on its core and below its
+// priority, and adds up the cycles it gets until the benchmark task clears active
+static void benchmark_spinner_task(void* arg)
+{
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint32_t own = 0;
+        uint32_t last = esp_cpu_get_cycle_count();
+        while (s_benchmark_spinner.active) {
+            const uint32_t now = esp_cpu_get_cycle_count();
+            if (now - last < BENCHMARK_SPIN_GAP_CYCLES) {
+                own += now - last;
+            }
+            last = now;
+        }
+        s_benchmark_spinner.own_cycles = own;
+        xTaskNotifyGive(s_benchmark_spinner.caller);
+    }
+}
+
+static void benchmark_run_refresh_cpu(const benchmark_context_t* context, TaskHandle_t spinner, benchmark_result_t* result)
+{
+    for (int i = 0; i < BENCHMARK_WARMUP_RUNS + BENCHMARK_SAMPLES; ++i) {
+        s_benchmark_spinner.active = true;
+        xTaskNotifyGive(spinner);
+        const uint32_t start = esp_cpu_get_cycle_count();
+        led_strip_refresh(context->strip);
+        const uint32_t cycles = esp_cpu_get_cycle_count() - start;
+        s_benchmark_spinner.active = false;
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (i >= BENCHMARK_WARMUP_RUNS) {
+            const uint32_t own = s_benchmark_spinner.own_cycles;
+            result->cycles[i - BENCHMARK_WARMUP_RUNS] = own < cycles ? cycles - own : 0;
+        }
+        // Neither task leaves time to the idle task of the core, which the task watchdog watches
+        vTaskDelay(1);
+    }
+}
+
+static void benchmark_print(benchmark_result_t* result)
+{
+    uint32_t* cycles = result->cycles;
+    // Insertion sort, for the median
+    for (int i = 1; i < BENCHMARK_SAMPLES; ++i) {
+        const uint32_t value = cycles[i];
+        int j = i;
+        for (; j > 0 && cycles[j - 1] > value; --j) {
+            cycles[j] = cycles[j - 1];
+        }
+        cycles[j] = value;
+    }
+    uint64_t sum = 0;
+    for (int i = 0; i < BENCHMARK_SAMPLES; ++i) {
+        sum += cycles[i];
+    }
+    const float mean = (float) sum / BENCHMARK_SAMPLES;
+    float variance = 0;
+    for (int i = 0; i < BENCHMARK_SAMPLES; ++i) {
+        variance += (cycles[i] - mean) * (cycles[i] - mean);
+    }
+    const uint32_t median = (cycles[BENCHMARK_SAMPLES / 2 - 1] + cycles[BENCHMARK_SAMPLES / 2]) / 2;
+    const float cycles_per_pixel = (float) median / result->leds;
+    const uint32_t cpu_mhz = esp_rom_get_cpu_ticks_per_us();
+    printf("BENCH {\"type\":\"result\",\"kernel\":\"%s\",\"format\":\"%s\",\"leds\":%" PRIu32 ",\"samples\":%d,"
+           "\"cycles_min\":%" PRIu32 ",\"cycles_median\":%" PRIu32 ",\"cycles_mean\":%.0f,\"cycles_max\":%" PRIu32 ","
+           "\"cycles_stddev\":%.0f,\"cycles_per_pixel\":%.2f,\"ns_per_pixel\":%.2f,\"runs_per_s\":%.1f}\n",
+           result->kernel, result->format, result->leds, BENCHMARK_SAMPLES,
+           cycles[0], median, mean, cycles[BENCHMARK_SAMPLES - 1],
+           sqrtf(variance / BENCHMARK_SAMPLES), cycles_per_pixel,
+           cycles_per_pixel * 1000 / cpu_mhz, median ? cpu_mhz * 1e6f / median : 0.0f);
+}
+
+static void benchmark_print_skipped(const char* kernel, const char* format, uint32_t leds, esp_err_t err)
+{
+    printf("BENCH {\"type\":\"skipped\",\"kernel\":\"%s\",\"format\":\"%s\",\"leds\":%" PRIu32 ",\"error\":\"%s\"}\n",
+           kernel, format, leds, esp_err_to_name(err));
+}
+
+// set_pixel, refresh and refresh_cpu on temporary strips of the configured backend
+static void benchmark_strip(const uint8_t* frame, bool rgbw, uint32_t leds, TaskHandle_t spinner)
+{
+    const char* format = rgbw ? "grbw" : "grb";
+    const led_strip_config_t strip_config = {
+        .strip_gpio_num = LED_STRIP_BLINK_GPIO,
+        .max_leds = leds,
+        .led_pixel_format = rgbw ? LED_PIXEL_FORMAT_GRBW : LED_PIXEL_FORMAT_GRB,
+        .led_model = rgbw ? LED_MODEL_SK6812 : LED_MODEL_WS2812,
+    };
+    benchmark_context_t context = {.rgbw = rgbw, .frame = frame};
+    const esp_err_t err = new_led_strip(&strip_config, NULL, &context.strip);
+    if (err != ESP_OK) {
+        benchmark_print_skipped("set_pixel", format, leds, err);
+        benchmark_print_skipped("refresh", format, leds, err);
+        benchmark_print_skipped("refresh_cpu", format, leds, err);
+        return;
+    }
+    benchmark_result_t result = {.kernel = "set_pixel", .format = format, .leds = leds};
+    benchmark_run_kernel(benchmark_set_pixels, &context, &result);
+    benchmark_print(&result);
+    // Never light the strip with the pattern of set_pixel
+    benchmark_blank_pixels(&context, leds);
+    result = (benchmark_result_t) {.kernel = "refresh", .format = format, .leds = leds};
+    benchmark_run_kernel(benchmark_refresh, &context, &result);
+    benchmark_print(&result);
+    result = (benchmark_result_t) {.kernel = "refresh_cpu", .format = format, .leds = leds};
+    benchmark_run_refresh_cpu(&context, spinner, &result);
+    benchmark_print(&result);
+    led_strip_clear(context.strip);
+    led_strip_del(context.strip);
+}
+
+static void benchmark_run(void)
+{
+    const esp_app_desc_t* app = esp_app_get_description();
+    printf("BENCH {\"type\":\"info\",\"version\":\"%s\",\"idf\":\"%s\",\"backend\":\"%s\",\"cpu_mhz\":%" PRIu32 ","
+           "\"core\":%d,\"warmup\":%d,\"samples\":%d}\n",
+           app->version, esp_get_idf_version(), LED_STRIP_BACKEND_NAME, esp_rom_get_cpu_ticks_per_us(),
+           esp_cpu_get_core_id(), BENCHMARK_WARMUP_RUNS, BENCHMARK_SAMPLES);
+
+    // Random content, large enough for a GRBW frame of the largest strip
+    const uint32_t max_leds = BENCHMARK_LED_COUNTS[sizeof(BENCHMARK_LED_COUNTS) / sizeof(BENCHMARK_LED_COUNTS[0]) - 1];
+    const size_t frame_size = max_leds * 4;
+    uint8_t* frame = heap_caps_malloc(frame_size, MALLOC_CAP_8BIT);
+    if (frame == NULL) {
+        ESP_LOGE(TAG_BENCHMARK, "Unable to allocate the test frame");
+        return;
+    }
+    esp_fill_random(frame, frame_size);
+#if CONFIG_TURBO_FRAME_AUTH
+    frame_auth_t auth;
+    const esp_err_t auth_err = frame_auth_init(&auth);
+#endif
+    // The spinning task of refresh_cpu, the benchmark task is raised above it
+    const UBaseType_t priority = uxTaskPriorityGet(NULL);
+    vTaskPrioritySet(NULL, tskIDLE_PRIORITY + 2);
+    s_benchmark_spinner.caller = xTaskGetCurrentTaskHandle();
+    TaskHandle_t spinner = NULL;
+    xTaskCreatePinnedToCore(benchmark_spinner_task, "bench_spin", 2048, NULL, tskIDLE_PRIORITY + 1, &spinner,
+                            esp_cpu_get_core_id());
+
+    for (size_t i = 0; i < sizeof(BENCHMARK_LED_COUNTS) / sizeof(BENCHMARK_LED_COUNTS[0]); ++i) {
+        for (int rgbw = 0; rgbw < 2; ++rgbw) {
+            const char* format = rgbw ? "grbw" : "grb";
+            benchmark_strip(frame, rgbw, BENCHMARK_LED_COUNTS[i], spinner);
+            const benchmark_context_t context = {.rgbw = rgbw, .frame = frame};
+            benchmark_result_t result = {.kernel = "frame_crc", .format = format, .leds = BENCHMARK_LED_COUNTS[i]};
+            benchmark_run_kernel(benchmark_frame_crc, &context, &result);
+            benchmark_print(&result);
+#if CONFIG_TURBO_FRAME_AUTH
+            if (auth_err != ESP_OK) {
+                benchmark_print_skipped("frame_auth", format, BENCHMARK_LED_COUNTS[i], auth_err);
+                continue;
+            }
+            const benchmark_context_t auth_context = {.rgbw = rgbw, .frame = frame, .auth = &auth};
+            result = (benchmark_result_t) {.kernel = "frame_auth", .format = format, .leds = BENCHMARK_LED_COUNTS[i]};
+            benchmark_run_kernel(benchmark_frame_auth, &auth_context, &result);
+            benchmark_print(&result);
+#endif
+        }
+    }
+
+    // The pixel buffer and the layout table have the size of the configured strip
+    prepare_pixel_buffer();
+    for (int format = 0; format < PIXEL_FORMAT_COUNT; ++format) {
+        const benchmark_context_t context = {.frame = frame, .pixel_format = format};
+        benchmark_result_t result = {.kernel = "show_frame", .format = PIXEL_FORMAT_NAMES[format], .leds = LED_STRIP_LED_NUMBERS};
+        benchmark_run_kernel(benchmark_show_frame, &context, &result);
+        benchmark_print(&result);
+    }
+#if CONFIG_TURBO_TRACE
+    // The events land in the trace rings, which the next events of the pipeline overwrite
+    for (size_t i = 0; i < sizeof(BENCHMARK_LED_COUNTS) / sizeof(BENCHMARK_LED_COUNTS[0]); ++i) {
+        const benchmark_context_t context = {0};
+        benchmark_result_t result = {.kernel = "trace_record", .format = "event", .leds = BENCHMARK_LED_COUNTS[i]};
+        benchmark_run_kernel(benchmark_trace_record, &context, &result);
+        benchmark_print(&result);
+    }
+#endif
+#if CONFIG_TURBO_FRAME_AUTH
+    if (auth_err == ESP_OK) {
+        mbedtls_gcm_free(&auth.gcm);
+    }
+#endif
+    vTaskDelete(spinner);
+    vTaskPrioritySet(NULL, priority);
+    heap_caps_free(frame);
+    ESP_LOGI(TAG_BENCHMARK, "Benchmarks done");
+}
+#endif
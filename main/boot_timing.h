@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+// Boot milestones. Timestamps come from esp_timer, which starts counting during the
+// startup code, so the bootloader time (a few tens of ms) is not included.
+typedef enum {
+    BOOT_PHASE_APP_MAIN,            // app_main() entered
+    BOOT_PHASE_FIRST_FRAME,         // Startup frame refreshed on the strip
+    BOOT_PHASE_NETWORK_UP,          // First interface got an IP
+    BOOT_PHASE_FIRST_NETWORK_FRAME, // First frame or audio message from the network shown
+    BOOT_PHASE_COUNT,
+} boot_phase_t;
+
+static const char* const BOOT_PHASE_NAMES[BOOT_PHASE_COUNT] = {
+    "app_main", "first frame", "network up", "first network frame",
+};
+
+static int64_t s_boot_phase_us[BOOT_PHASE_COUNT];
+
+// Records the first time a phase is reached, later calls are ignored.
+static void boot_phase_record(boot_phase_t phase)
+{
+    if (s_boot_phase_us[phase] != 0) {
+        return;
+    }
+    s_boot_phase_us[phase] = esp_timer_get_time();
+    ESP_LOGI("boot", "%s at %" PRId64 " ms", BOOT_PHASE_NAMES[phase], s_boot_phase_us[phase] / 1000);
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+// Traffic capture, enabled by CONFIG_TURBO_CAPTURE. The TCP server records the bytes
+// returned by each of its recv() calls with their arrival time, so that the stream of
+// a controller can be replayed later with its segmentation and timing, see
+// tools/replay.py. The capture holds the beginning of the last connection: it starts
+// over with the first bytes of a new connection, keeping the format header that a
+// replay needs, and stops recording when the buffer is full. capture_server.h sends it
+// on request.
+//
+// The lock is never held across a socket call, only for one copy into the buffer or
+// for a snapshot of the counters, so neither task waits on the other's client. The
+// buffer is not written while a download reads it: the bytes received meanwhile are
+// dropped.
+#if CONFIG_TURBO_CAPTURE
+#define CAPTURE_BUFFER_SIZE (CONFIG_TURBO_CAPTURE_SIZE_KB * 1024)
+
+// Header of each recv() in the buffer, followed by its bytes
+typedef struct {
+    uint32_t time_us; // Since the connection was accepted
+    uint32_t length;
+} capture_record_t;
+
+typedef struct {
+    // Guards the fields up to dumping
+    SemaphoreHandle_t lock;
+    StaticSemaphore_t lock_storage;
+    uint8_t* buffer;
+    size_t used;
+    uint32_t record_count;
+    // Bytes received after the end of the capture: the buffer filled up, or the bytes
+    // arrived while it was being downloaded
+    uint32_t bytes_dropped;
+    // Set by the capture server while it sends the buffer
+    bool dumping;
+    // Only used by the TCP server task, without the lock
+    int64_t start_us;
+    // A connection was accepted, the capture starts over at its first record
+    bool reset_pending;
+    // Bytes dropped while the capture server held the lock, not yet counted
+    uint32_t pending_dropped;
+} capture_t;
+
+static capture_t s_capture;
+
+static esp_err_t capture_init(void)
+{
+    // PSRAM when there is some, the capture is only read by the network tasks
+    s_capture.buffer = heap_caps_malloc(CAPTURE_BUFFER_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (s_capture.buffer == NULL) {
+        s_capture.buffer = heap_caps_malloc(CAPTURE_BUFFER_SIZE, MALLOC_CAP_8BIT);
+    }
+    if (s_capture.buffer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_capture.lock = xSemaphoreCreateMutexStatic(&s_capture.lock_storage);
+    return ESP_OK;
+}
+
+// Replaces the capture of the previous connection, from the first record of the new one
+static void capture_begin(void)
+{
+    s_capture.reset_pending = true;
+    s_capture.pending_dropped = 0;
+    s_capture.start_us = esp_timer_get_time();
+}
+
+// Never waits: the bytes are dropped while the capture server holds the lock
+static void capture_recv(const void* data, size_t length)
+{
+    const capture_record_t record = {
+        .time_us = esp_timer_get_time() - s_capture.start_us,
+        .length = length,
+    };
+    if (xSemaphoreTake(s_capture.lock, 0) != pdTRUE) {
+        s_capture.pending_dropped += length;
+        return;
+    }
+    if (s_capture.reset_pending) {
+        // The buffer is only written below, once no download reads it
+        s_capture.used = 0;
+        s_capture.record_count = 0;
+        s_capture.bytes_dropped = 0;
+        s_capture.reset_pending = false;
+    }
+    s_capture.bytes_dropped += s_capture.pending_dropped;
+    s_capture.pending_dropped = 0;
+    // A hole in the stream would misalign the replay: the capture ends at the first one
+    if (s_capture.dumping || s_capture.bytes_dropped > 0
+            || s_capture.used + sizeof(record) + length > CAPTURE_BUFFER_SIZE) {
+        s_capture.bytes_dropped += length;
+    } else {
+        memcpy(s_capture.buffer + s_capture.used, &record, sizeof(record));
+        memcpy(s_capture.buffer + s_capture.used + sizeof(record), data, length);
+        s_capture.used += sizeof(record) + length;
+        ++s_capture.record_count;
+    }
+    xSemaphoreGive(s_capture.lock);
+}
+
+#define CAPTURE_BEGIN() capture_begin()
+#define CAPTURE_RECV(data, length) capture_recv((data), (length))
+#else
+#define CAPTURE_BEGIN()
+#define CAPTURE_RECV(data, length)
+#endif
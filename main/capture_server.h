@@ -0,0 +1,126 @@
+#include <string.h>
+#include "esp_log.h"
+#include "lwip/sockets.h"
+#include "capture.h"
+
+// Sends the traffic capture to any client connecting to the capture port, then closes
+// the connection. The capture is kept and can be downloaded again until the next TCP
+// connection replaces it. A client that stops reading is dropped after
+// CAPTURE_SEND_TIMEOUT_S, recording resumes with the next TCP connection. Layout of the dump, little endian:
+//   header: "TLCP", version (CAPTURE_DUMP_VERSION), flags (CAPTURE_FLAG_*), 16 bits
+//           reserved, frame size, record count, bytes dropped, size of the records,
+//           all 32 bits
+//   records: capture_record_t followed by the bytes of the recv() call, in order
+#if CONFIG_TURBO_CAPTURE
+static const char *TAG_CAPTURE = "capture_server";
+static const uint8_t CAPTURE_DUMP_VERSION = 1;
+static const int CAPTURE_SEND_TIMEOUT_S = 5;
+// The stream carries a CRC-32 after each record, CONFIG_TURBO_FRAME_CRC
+#define CAPTURE_FLAG_FRAME_CRC 0x01
+// The stream opens with a format header and is made of records, CONFIG_TURBO_TCP_RECORDS
+#define CAPTURE_FLAG_RECORDS 0x02
+#if CONFIG_TURBO_FRAME_CRC
+#define CAPTURE_FLAGS_CRC CAPTURE_FLAG_FRAME_CRC
+#else
+#define CAPTURE_FLAGS_CRC 0
+#endif
+#if CONFIG_TURBO_TCP_RECORDS
+#define CAPTURE_FLAGS_RECORDS CAPTURE_FLAG_RECORDS
+#else
+#define CAPTURE_FLAGS_RECORDS 0
+#endif
+static const uint8_t CAPTURE_DUMP_FLAGS = CAPTURE_FLAGS_CRC | CAPTURE_FLAGS_RECORDS;
+
+typedef struct {
+    char magic[4];
+    uint8_t version;
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t frame_size;
+    uint32_t record_count;
+    uint32_t bytes_dropped;
+    uint32_t records_size;
+} capture_dump_header_t;
+
+static bool capture_send_all(int sock, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*) data;
+    while (size > 0) {
+        const int len = send(sock, bytes, size, 0);
+        if (len < 0) {
+            // EAGAIN after CAPTURE_SEND_TIMEOUT_S without progress
+            ESP_LOGE(TAG_CAPTURE, "Error occurred during sending: errno %d", errno);
+            return false;
+        }
+        bytes += len;
+        size -= len;
+    }
+    return true;
+}
+
+static void capture_dump(int sock, uint32_t frame_size)
+{
+    // Recording pauses for the download, the capture ends there if data comes in. The
+    // recorder holds the lock for one copy at most.
+    xSemaphoreTake(s_capture.lock, portMAX_DELAY);
+    s_capture.dumping = true;
+    const capture_dump_header_t header = {
+        .magic = {'T', 'L', 'C', 'P'},
+        .version = CAPTURE_DUMP_VERSION,
+        .flags = CAPTURE_DUMP_FLAGS,
+        .frame_size = frame_size,
+        .record_count = s_capture.record_count,
+        .bytes_dropped = s_capture.bytes_dropped,
+        .records_size = s_capture.used,
+    };
+    xSemaphoreGive(s_capture.lock);
+    const bool ok = capture_send_all(sock, &header, sizeof(header))
+                    && capture_send_all(sock, s_capture.buffer, header.records_size);
+    xSemaphoreTake(s_capture.lock, portMAX_DELAY);
+    s_capture.dumping = false;
+    xSemaphoreGive(s_capture.lock);
+    ESP_LOGI(TAG_CAPTURE, "Capture of %" PRIu32 " records %s", header.record_count, ok ? "sent" : "incomplete");
+}
+
+static void capture_server_task(void* pvParameters)
+{
+    static const uint32_t port = 1239;
+    const ledstrip_pipeline_t* pipeline = (const ledstrip_pipeline_t*) pvParameters;
+    struct sockaddr_in dest_addr = {
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+    };
+
+    int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (listen_sock < 0) {
+        ESP_LOGE(TAG_CAPTURE, "Unable to create socket: errno %d", errno);
+        vTaskDelete(NULL);
+        return;
+    }
+    int opt = 1;
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (bind(listen_sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) != 0 || listen(listen_sock, 1) != 0) {
+        ESP_LOGE(TAG_CAPTURE, "Socket unable to listen: errno %d", errno);
+        close(listen_sock);
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(TAG_CAPTURE, "Socket listening, port %" PRIu32 ", %d KB of capture", port, CONFIG_TURBO_CAPTURE_SIZE_KB);
+
+    while (true) {
+        const int sock = accept(listen_sock, NULL, NULL);
+        if (sock < 0) {
+            ESP_LOGE(TAG_CAPTURE, "Unable to accept connection: errno %d", errno);
+            break;
+        }
+        const struct timeval timeout = {.tv_sec = CAPTURE_SEND_TIMEOUT_S};
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        capture_dump(sock, pipeline->frame_size);
+        shutdown(sock, SHUT_RDWR);
+        close(sock);
+    }
+    close(listen_sock);
+    vTaskDelete(NULL);
+}
+#endif
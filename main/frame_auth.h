@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_random.h"
+#include "mbedtls/gcm.h"
+
+// Authenticated encryption of the TCP stream, enabled by CONFIG_TURBO_FRAME_AUTH, for
+// receivers on networks shared with untrusted hosts. The payload of every record, a
+// frame or a palette, is encrypted with AES-GCM under the key of
+// CONFIG_TURBO_FRAME_AUTH_KEY and followed by its 16-byte tag, in place of the CRC
+// trailer. The payload is decrypted in place in the frame buffer once the tag has
+// arrived, and is only handed to the LED task when the tag matches. mbedtls runs the
+// AES rounds on the AES accelerator of the chip (CONFIG_MBEDTLS_HARDWARE_AES).
+//
+// On each connection, the receiver first sends a random session id of
+// FRAME_AUTH_SESSION_ID_SIZE bytes. The nonce of the n-th record of the connection,
+// from 0, is the session id followed by n as a 32-bit big-endian number: a record can
+// neither be replayed, reordered nor moved to another connection. The additional
+// data is the record type byte ('F' for the frames of a stream without
+// CONFIG_TURBO_TCP_RECORDS) followed by the negotiated pixel_format_t byte. With Python's cryptography:
+//     nonce = session_id + struct.pack(">I", n)
+//     sealed = AESGCM(key).encrypt(nonce, payload, bytes([record, format]))
+// sealed is the payload followed by the tag, ready to be sent after the record byte.
+//
+// The other receivers have no authentication: main.c does not start the audio and
+// WebSocket servers with CONFIG_TURBO_FRAME_AUTH, and multicast cannot be enabled.
+#if CONFIG_TURBO_FRAME_AUTH
+#if CONFIG_TURBO_MULTICAST
+#error "CONFIG_TURBO_MULTICAST would accept unauthenticated frames, disable it with CONFIG_TURBO_FRAME_AUTH"
+#endif
+#define FRAME_AUTH_TAG_SIZE 16
+#define FRAME_AUTH_SESSION_ID_SIZE 8
+#define FRAME_AUTH_NONCE_SIZE (FRAME_AUTH_SESSION_ID_SIZE + 4)
+#define FRAME_AUTH_AAD_SIZE 2
+
+typedef struct {
+    mbedtls_gcm_context gcm;
+    // Session id followed by the counter of the next record
+    uint8_t nonce[FRAME_AUTH_NONCE_SIZE];
+    uint32_t counter;
+} frame_auth_t;
+
+static int frame_auth_hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Loads the key of CONFIG_TURBO_FRAME_AUTH_KEY: 32 hex digits for AES-128, 64 for
+// AES-256. Anything else is rejected, there is no default key.
+static esp_err_t frame_auth_init(frame_auth_t* auth)
+{
+    static const char KEY_HEX[] = CONFIG_TURBO_FRAME_AUTH_KEY;
+    const size_t key_size = (sizeof(KEY_HEX) - 1) / 2;
+    if (key_size != 16 && key_size != 32) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t key[32];
+    for (size_t i = 0; i < key_size; ++i) {
+        const int high = frame_auth_hex_digit(KEY_HEX[2 * i]);
+        const int low = frame_auth_hex_digit(KEY_HEX[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        key[i] = high << 4 | low;
+    }
+    mbedtls_gcm_init(&auth->gcm);
+    const int ret = mbedtls_gcm_setkey(&auth->gcm, MBEDTLS_CIPHER_ID_AES, key, key_size * 8);
+    memset(key, 0, sizeof(key));
+    if (ret != 0) {
+        mbedtls_gcm_free(&auth->gcm);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Draws the id of a new session, to be sent to the client
+static void frame_auth_start_session(frame_auth_t* auth, uint8_t session_id[FRAME_AUTH_SESSION_ID_SIZE])
+{
+    esp_fill_random(session_id, FRAME_AUTH_SESSION_ID_SIZE);
+    memcpy(auth->nonce, session_id, FRAME_AUTH_SESSION_ID_SIZE);
+    auth->counter = 0;
+}
+
+// Checks the tag of a record and decrypts its payload in place. The counter moves on
+// even when the check fails, so that it stays in step with the sender.
+static bool frame_auth_open(frame_auth_t* auth, uint8_t* payload, size_t size,
+                            const uint8_t aad[FRAME_AUTH_AAD_SIZE], const uint8_t tag[FRAME_AUTH_TAG_SIZE])
+{
+    uint8_t* counter = auth->nonce + FRAME_AUTH_SESSION_ID_SIZE;
+    counter[0] = auth->counter >> 24;
+    counter[1] = auth->counter >> 16;
+    counter[2] = auth->counter >> 8;
+    counter[3] = auth->counter;
+    ++auth->counter;
+    return mbedtls_gcm_auth_decrypt(&auth->gcm, size, auth->nonce, sizeof(auth->nonce), aad, FRAME_AUTH_AAD_SIZE,
+                                    tag, FRAME_AUTH_TAG_SIZE, payload, payload) == 0;
+}
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+#include "esp_heap_caps.h"
+#include "esp_memory_utils.h"
+
+// Allocator for bulk frame memory: the frame pool and any buffer only touched by
+// tasks (history, recordings, mappings). It goes to PSRAM when the board has some so
+// that long strips and deep buffering do not eat internal SRAM, and falls back to
+// internal RAM otherwise. The transmit buffer is owned by the led_strip driver and
+// always stays in internal RAM, show_frame() copies each frame into it.
+static void* frame_store_calloc(size_t count, size_t size)
+{
+    void* buffer = heap_caps_calloc(count, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (buffer == NULL) {
+        buffer = heap_caps_calloc(count, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return buffer;
+}
+
+static const char* frame_store_location(const void* buffer)
+{
+    return esp_ptr_external_ram(buffer) ? "PSRAM" : "internal RAM";
+}
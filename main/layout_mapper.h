@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Physical layout of an installation. Clients always send pixels in logical order
+// (row-major image for a matrix, concatenated logical ranges otherwise); the layout is
+// compiled once at startup into a table giving, for each physical LED, the logical
+// pixel it shows. Applying it costs one indexed load per pixel.
+#define LAYOUT_UNMAPPED UINT16_MAX
+
+typedef enum {
+    LAYOUT_LINEAR,   // Physical order is the logical order
+    LAYOUT_MATRIX,   // width x height image on a panel
+    LAYOUT_SEGMENTS, // Physical strip built from runs of logical pixels
+} layout_type_t;
+
+// Clockwise rotation of the image on the panel
+typedef enum {
+    LAYOUT_ROTATE_0,
+    LAYOUT_ROTATE_90,
+    LAYOUT_ROTATE_180,
+    LAYOUT_ROTATE_270,
+} layout_rotation_t;
+
+// Run of physical LEDs showing logical pixels [logical_start, logical_start + length).
+// Listing the same logical range twice repeats it, a reversed repeat mirrors it.
+typedef struct {
+    uint16_t logical_start;
+    uint16_t length;
+    bool reversed;
+} layout_segment_t;
+
+typedef struct {
+    layout_type_t type;
+    // LAYOUT_MATRIX, dimensions of the logical image
+    uint16_t width;
+    uint16_t height;
+    bool serpentine; // Every other physical row is wired backwards
+    bool mirror;     // Image flipped horizontally before rotation
+    layout_rotation_t rotation;
+    // LAYOUT_SEGMENTS, in physical order
+    const layout_segment_t* segments;
+    size_t segment_count;
+} layout_config_t;
+
+static void layout_compile_matrix(const layout_config_t* layout, uint16_t* lut, size_t physical_count)
+{
+    const bool swapped = layout->rotation == LAYOUT_ROTATE_90 || layout->rotation == LAYOUT_ROTATE_270;
+    const uint32_t width = layout->width;
+    const uint32_t height = layout->height;
+    const uint32_t panel_width = swapped ? height : width;
+    const size_t mapped = width * height < physical_count ? width * height : physical_count;
+    for (size_t p = 0; p < mapped; ++p) {
+        const uint32_t y = p / panel_width;
+        uint32_t x = p % panel_width;
+        if (layout->serpentine && (y & 1)) {
+            x = panel_width - 1 - x;
+        }
+
+        uint32_t image_x, image_y;
+        switch (layout->rotation) {
+        case LAYOUT_ROTATE_90:
+            image_x = y;
+            image_y = height - 1 - x;
+            break;
+        case LAYOUT_ROTATE_180:
+            image_x = width - 1 - x;
+            image_y = height - 1 - y;
+            break;
+        case LAYOUT_ROTATE_270:
+            image_x = width - 1 - y;
+            image_y = x;
+            break;
+        default:
+            image_x = x;
+            image_y = y;
+            break;
+        }
+        if (layout->mirror) {
+            image_x = width - 1 - image_x;
+        }
+        lut[p] = image_y * width + image_x;
+    }
+}
+
+static esp_err_t layout_compile_segments(const layout_config_t* layout, uint16_t* lut, size_t physical_count,
+                                         size_t logical_count)
+{
+    size_t p = 0;
+    for (size_t s = 0; s < layout->segment_count; ++s) {
+        const layout_segment_t* segment = &layout->segments[s];
+        if (segment->logical_start + segment->length > logical_count || p + segment->length > physical_count) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        for (uint32_t i = 0; i < segment->length; ++i) {
+            const uint32_t offset = segment->reversed ? segment->length - 1 - i : i;
+            lut[p++] = segment->logical_start + offset;
+        }
+    }
+    return ESP_OK;
+}
+
+// Fills lut[physical_count] with the logical pixel shown by each physical LED, or
+// LAYOUT_UNMAPPED for LEDs left dark.
+static esp_err_t layout_compile(const layout_config_t* layout, uint16_t* lut, size_t physical_count,
+                                size_t logical_count)
+{
+    if (physical_count > LAYOUT_UNMAPPED || logical_count > LAYOUT_UNMAPPED) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (size_t p = 0; p < physical_count; ++p) {
+        lut[p] = LAYOUT_UNMAPPED;
+    }
+
+    switch (layout->type) {
+    case LAYOUT_LINEAR:
+        for (size_t p = 0; p < physical_count && p < logical_count; ++p) {
+            lut[p] = p;
+        }
+        return ESP_OK;
+    case LAYOUT_MATRIX:
+        if (layout->width == 0 || layout->height == 0 || (size_t) layout->width * layout->height > logical_count) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        layout_compile_matrix(layout, lut, physical_count);
+        return ESP_OK;
+    case LAYOUT_SEGMENTS:
+        return layout_compile_segments(layout, lut, physical_count, logical_count);
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+}
@@ -1,63 +1,590 @@
 #include <stdio.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "led_strip.h"
 #include "esp_log.h"
 #include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "nvs.h"
+#include "esp_rom_crc.h"
+#include "ledstrip_pipeline.h"
+#include "audio_renderer.h"
+#include "boot_timing.h"
+#include "layout_mapper.h"
+#include "rgbw.h"
+#include "power_limiter.h"
+#include "trace.h"
 
 // GPIO assignment
 static const char* TAG = "turbo_ledstrip";
 static const int LED_STRIP_BLINK_GPIO = 17;
 // static const int LED_STRIP_BLINK_GPIO = 4;
 // Numbers of the LED in the strip
-static const uint32_t LED_STRIP_LED_NUMBERS = 300;
+#define LED_STRIP_LED_NUMBERS 300
+#if CONFIG_TURBO_LED_RGBW
+// Bytes per pixel in the strip memory, GRBW
+#define LED_STRIP_BYTES_PER_PIXEL 4
+#define LED_STRIP_PIXEL_FORMAT LED_PIXEL_FORMAT_GRBW
+#define LED_STRIP_MODEL LED_MODEL_SK6812
+#else
+// Bytes per pixel in the strip memory, GRB
+#define LED_STRIP_BYTES_PER_PIXEL 3
+#define LED_STRIP_PIXEL_FORMAT LED_PIXEL_FORMAT_GRB
+#define LED_STRIP_MODEL LED_MODEL_WS2812
+#endif
+// Bytes per pixel in the received frames, RGB or RGBW
+#if CONFIG_TURBO_INPUT_RGBW
+#define LED_STRIP_FRAME_CHANNELS 4
+#else
+#define LED_STRIP_FRAME_CHANNELS 3
+#endif
+#define LED_STRIP_FRAME_SIZE (LED_STRIP_LED_NUMBERS * LED_STRIP_FRAME_CHANNELS)
 // 10MHz resolution, 1 tick = 0.1us (led strip needs a high resolution)
 static const int LED_STRIP_RMT_RES_HZ = 10 * 1000 * 1000;
-led_strip_handle_t configure_led(void)
+#if CONFIG_TURBO_LED_BACKEND_SPI
+#define LED_STRIP_BACKEND_NAME "SPI"
+#elif CONFIG_TURBO_LED_BACKEND_PARALLEL
+#define LED_STRIP_BACKEND_NAME "parallel"
+#else
+#define LED_STRIP_BACKEND_NAME "RMT"
+#endif
+#if CONFIG_TURBO_LED_BACKEND_SPI
+// The whole bus is taken by the strip, only MOSI is routed
+static const spi_host_device_t LED_STRIP_SPI_HOST = (spi_host_device_t) CONFIG_TURBO_LED_SPI_HOST;
+#if CONFIG_ETHERNET_SPI_SUPPORT && CONFIG_TURBO_LED_SPI_HOST == CONFIG_ETHERNET_SPI_HOST
+// The LED task starts first: Ethernet would fail to initialize the bus and the board
+// would silently fall back to Wi-Fi
+#error "CONFIG_TURBO_LED_SPI_HOST must differ from CONFIG_ETHERNET_SPI_HOST"
+#endif
+#endif
+#if CONFIG_TURBO_LED_BACKEND_PARALLEL
+// With n = LED_STRIP_PARALLEL_LEDS_PER_LANE(LED_STRIP_LED_NUMBERS), physical LED i is
+// LED i % n of lane i / n; describe the wiring with LED_STRIP_LAYOUT.
+#define LED_STRIP_PARALLEL_LANES 8
+#define LED_STRIP_PARALLEL_LEDS_PER_LANE(leds) (((leds) + LED_STRIP_PARALLEL_LANES - 1) / LED_STRIP_PARALLEL_LANES)
+static const int LED_STRIP_PARALLEL_GPIOS[LED_STRIP_PARALLEL_LANES] = {16, 17, 18, 19, 21, 22, 23, 25};
+// Bus clock and D/C outputs of the peripheral, left unconnected
+static const int LED_STRIP_PARALLEL_CLK_GPIO = 26;
+static const int LED_STRIP_PARALLEL_DC_GPIO = 27;
+#endif
+// Latency budget: when more than one message is waiting after a refresh, drop the
+// older ones and show the newest. Set to false to display every received frame.
+static const bool LED_STRIP_DROP_STALE_FRAMES = true;
+// Refreshes are skipped while the pixel buffer is identical to the latched one. The
+// strip is still refreshed at this interval, in microseconds, to recover from a glitch.
+static const int64_t LED_STRIP_KEEPALIVE_PERIOD_US = 1000 * 1000;
+// Interval between two statistics reports, in microseconds
+static const int64_t LED_STRIP_STATS_PERIOD_US = 5 * 1000 * 1000;
+// Frame shown right after power-on, before the network is up: a blob of
+// LED_STRIP_FRAME_SIZE bytes in NVS, provisioned with the NVS partition generator.
+// Without it the strip is filled with LED_STRIP_STARTUP_COLOR.
+static const char LED_STRIP_NVS_NAMESPACE[] = "ledstrip";
+static const char LED_STRIP_NVS_STARTUP_FRAME_KEY[] = "startup_frame";
+static const uint8_t LED_STRIP_STARTUP_COLOR[4] = {16, 8, 0, 0};
+#if CONFIG_TURBO_LED_RGBW && !CONFIG_TURBO_INPUT_RGBW
+// White point used to extract the white channel from RGB frames, see rgbw.h
+static const uint8_t* const LED_STRIP_WHITE_POINT = RGBW_WHITE_POINT_NEUTRAL;
+static rgbw_converter_t s_rgbw_converter;
+#endif
+// Physical wiring of the installation, see layout_mapper.h. For instance a 20x15 panel
+// wired in serpentine rows and mounted upside down:
+//   {.type = LAYOUT_MATRIX, .width = 20, .height = 15, .serpentine = true, .rotation = LAYOUT_ROTATE_180}
+static const layout_config_t LED_STRIP_LAYOUT = {.type = LAYOUT_LINEAR};
+// Current budget of the strip supply. A full white WS2812 draws about 60 mA, so 300 of
+// them would pull 18 A: frames above the budget are dimmed to fit it.
+static const power_limiter_config_t LED_STRIP_POWER_LIMIT = {
+    .budget_ma = 4000,
+    .ma_per_channel = 20,
+    .idle_ma_per_led = 1,
+};
+
+typedef struct {
+    uint32_t frames_shown;
+    uint32_t frames_skipped;
+    // Messages whose content matched the latched pixels, not refreshed
+    uint32_t refreshes_skipped;
+    uint32_t keepalive_refreshes;
+    // Time ledstrip_task spends blocked in led_strip_refresh(). Reset on every report.
+    int64_t refresh_sum_us;
+    int64_t refresh_max_us;
+    uint32_t refresh_count;
+    // Time spent copying frames from the frame store into the transmit buffer, by
+    // input pixel format: the decode cost of each format. Reset on every report.
+    int64_t copy_sum_us[PIXEL_FORMAT_COUNT];
+    int64_t copy_max_us[PIXEL_FORMAT_COUNT];
+    uint32_t copy_count[PIXEL_FORMAT_COUNT];
+    // Estimated current before limiting, and number of frames dimmed by the limiter.
+    // Reset on every report.
+    uint64_t current_sum_ma;
+    uint32_t current_max_ma;
+    uint32_t current_count;
+    uint32_t frames_limited;
+    // Message-to-photon latency, from reception to the end of the refresh.
+    // Reset on every report.
+    int64_t latency_sum_us[LEDSTRIP_MESSAGE_TYPE_COUNT];
+    int64_t latency_max_us[LEDSTRIP_MESSAGE_TYPE_COUNT];
+    uint32_t latency_count[LEDSTRIP_MESSAGE_TYPE_COUNT];
+} ledstrip_stats_t;
+
+static ledstrip_stats_t s_ledstrip_stats;
+
+// Pixel buffer, GRB(W). Frames are written straight into it through the layout table
+// instead of going through led_strip_set_pixel() one pixel at a time. It is the RMT
+// driver buffer itself, and the raw pixel buffer of the streaming SPI backend; the other
+// SPI modes and the parallel backend encode it on each refresh.
+#if CONFIG_TURBO_STATIC_PIPELINE
+static uint8_t s_led_strip_pixel_storage[LED_STRIP_LED_NUMBERS * LED_STRIP_BYTES_PER_PIXEL];
+static uint8_t* s_led_strip_pixels = s_led_strip_pixel_storage;
+#else
+static uint8_t* s_led_strip_pixels = NULL;
+#endif
+// Logical pixel shown by each physical LED, compiled from LED_STRIP_LED_NUMBERS
+static uint16_t s_layout_lut[LED_STRIP_LED_NUMBERS];
+// Colors of PIXEL_FORMAT_PALETTE8 frames, a gray ramp until a client uploads a palette
+static pixel_palette_t s_palette;
+
+#if CONFIG_TURBO_TRACE && !CONFIG_TURBO_LED_BACKEND_SPI && !CONFIG_TURBO_LED_BACKEND_PARALLEL
+static IRAM_ATTR bool trace_rmt_done(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t* event, void* ctx)
 {
-    // LED strip general initialization, according to your led board design
-    led_strip_config_t strip_config = {
-        .strip_gpio_num = LED_STRIP_BLINK_GPIO,   // The GPIO that connected to the LED strip's data line
-        .max_leds = LED_STRIP_LED_NUMBERS,        // The number of LEDs in the strip,
-        .led_pixel_format = LED_PIXEL_FORMAT_GRB, // Pixel format of your LED strip
-        .led_model = LED_MODEL_WS2812,            // LED strip model
-        .flags.invert_out = false,                // whether to invert the output signal
-    };
+    TRACE_INSTANT(TRACE_RMT_DONE, 0);
+    return false;
+}
+#endif
 
+// Creates a strip on the configured backend. pixel_buf is the GRB(W) buffer read by the
+// RMT and streaming SPI backends, NULL to let the driver allocate it. With the parallel
+// backend, max_leds is spread over the lanes.
+static esp_err_t new_led_strip(const led_strip_config_t* config, uint8_t* pixel_buf, led_strip_handle_t* led_strip)
+{
+#if CONFIG_TURBO_LED_BACKEND_SPI
+    led_strip_spi_config_t spi_config = {
+        .clk_src = SPI_CLK_SRC_DEFAULT,
+        .spi_bus = LED_STRIP_SPI_HOST,
+        .flags.with_dma = true,
+#if CONFIG_TURBO_LED_SPI_ASYNC_REFRESH
+        .flags.async_refresh = true,
+#elif CONFIG_TURBO_LED_SPI_STREAM
+        .pixel_buf = pixel_buf,
+        .flags.stream = true,
+#endif
+    };
+    return led_strip_new_spi_device(config, &spi_config, led_strip);
+#elif CONFIG_TURBO_LED_BACKEND_PARALLEL
+    led_strip_parallel_config_t parallel_config = {
+        .lane_count = LED_STRIP_PARALLEL_LANES,
+        .clk_gpio_num = LED_STRIP_PARALLEL_CLK_GPIO,
+        .dc_gpio_num = LED_STRIP_PARALLEL_DC_GPIO,
+    };
+    memcpy(parallel_config.lane_gpio_nums, LED_STRIP_PARALLEL_GPIOS, sizeof(LED_STRIP_PARALLEL_GPIOS));
+    led_strip_config_t lane_config = *config;
+    lane_config.max_leds = LED_STRIP_PARALLEL_LEDS_PER_LANE(config->max_leds);
+    return led_strip_new_parallel_device(&lane_config, &parallel_config, led_strip);
+#else
     // LED strip backend configuration: RMT
     led_strip_rmt_config_t rmt_config = {
         .clk_src = RMT_CLK_SRC_DEFAULT,        // different clock source can lead to different power consumption
         .resolution_hz = LED_STRIP_RMT_RES_HZ, // RMT counter clock frequency
+        .pixel_buf = pixel_buf,                // Written directly by show_frame()
+#if CONFIG_TURBO_TRACE
+        .on_trans_done = trace_rmt_done,
+#endif
         .flags.with_dma = false,               // DMA feature is available on ESP target like ESP32-S3
     };
+    return led_strip_new_rmt_device(config, &rmt_config, led_strip);
+#endif
+}
+
+// Tables and buffer used by show_frame()
+static void prepare_pixel_buffer(void)
+{
+    ESP_ERROR_CHECK(layout_compile(&LED_STRIP_LAYOUT, s_layout_lut, LED_STRIP_LED_NUMBERS, LED_STRIP_LED_NUMBERS));
+#if CONFIG_TURBO_LED_RGBW && !CONFIG_TURBO_INPUT_RGBW
+    rgbw_converter_init(&s_rgbw_converter, LED_STRIP_WHITE_POINT);
+#endif
+    pixel_format_init();
+    for (uint32_t i = 0; i < PIXEL_PALETTE_ENTRIES; ++i) {
+        s_palette[i][0] = s_palette[i][1] = s_palette[i][2] = i;
+    }
+    if (s_led_strip_pixels == NULL) {
+        // Read by the RMT ISR or by the SPI encoder, keep it in internal RAM
+        s_led_strip_pixels = heap_caps_calloc(LED_STRIP_LED_NUMBERS, LED_STRIP_BYTES_PER_PIXEL,
+                                              MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        ESP_ERROR_CHECK(s_led_strip_pixels ? ESP_OK : ESP_ERR_NO_MEM);
+    }
+}
+
+led_strip_handle_t configure_led(void)
+{
+    prepare_pixel_buffer();
+    if (power_limiter_budget_below_idle(&LED_STRIP_POWER_LIMIT, LED_STRIP_LED_NUMBERS)) {
+        ESP_LOGW(TAG, "Power budget of %" PRIu32 " mA is below the idle current of %d LEDs, every frame will be blank",
+                 LED_STRIP_POWER_LIMIT.budget_ma, LED_STRIP_LED_NUMBERS);
+    }
+
+    // LED strip general initialization, according to your led board design
+    led_strip_config_t strip_config = {
+        .strip_gpio_num = LED_STRIP_BLINK_GPIO,   // The GPIO that connected to the LED strip's data line
+        .max_leds = LED_STRIP_LED_NUMBERS,        // The number of LEDs in the strip,
+        .led_pixel_format = LED_STRIP_PIXEL_FORMAT, // Pixel format of your LED strip
+        .led_model = LED_STRIP_MODEL,             // LED strip model
+        .flags.invert_out = false,                // whether to invert the output signal
+    };
 
-    // LED Strip object handle
     led_strip_handle_t led_strip;
-    ESP_ERROR_CHECK(led_strip_new_rmt_device(&strip_config, &rmt_config, &led_strip));
-    ESP_LOGI(TAG, "Created LED strip object with RMT backend");
+    ESP_ERROR_CHECK(new_led_strip(&strip_config, s_led_strip_pixels, &led_strip));
+    ESP_LOGI(TAG, "Created LED strip object with %s backend", LED_STRIP_BACKEND_NAME);
     return led_strip;
 }
 
+// Replaces the message by the newest one waiting in the queue, so the next refresh
+// shows the most recent data instead of working through the backlog.
+static void skip_stale_messages(ledstrip_pipeline_t* pipeline, ledstrip_message_t* message)
+{
+    while (uxQueueMessagesWaiting(pipeline->messages) > 0) {
+        if (message->type == LEDSTRIP_MESSAGE_FRAME) {
+            ++s_ledstrip_stats.frames_skipped;
+        } else if (message->type == LEDSTRIP_MESSAGE_PALETTE) {
+            // The frames that follow depend on it
+            memcpy(s_palette, message->frame, PIXEL_PALETTE_SIZE);
+        }
+        ledstrip_pipeline_release_message(pipeline, message);
+        xQueueReceive(pipeline->messages, message, 0);
+    }
+}
+
+// Writes the GRB(W) bytes of an RGB color
+static inline void store_rgb(uint8_t* pixel, const uint8_t rgb[3])
+{
+#if CONFIG_TURBO_LED_RGBW && !CONFIG_TURBO_INPUT_RGBW
+    rgbw_convert(&s_rgbw_converter, rgb, pixel);
+#else
+    pixel[0] = rgb[1];
+    pixel[1] = rgb[0];
+    pixel[2] = rgb[2];
+#if CONFIG_TURBO_LED_RGBW
+    pixel[3] = 0;
+#endif
+#endif
+}
+
+static inline uint32_t pixel_sum(const uint8_t* pixel)
+{
+#if CONFIG_TURBO_LED_RGBW
+    return pixel[0] + pixel[1] + pixel[2] + pixel[3];
+#else
+    return pixel[0] + pixel[1] + pixel[2];
+#endif
+}
+
+// Pixel writers of show_frame(), one per frame format
+static inline void show_pixel_native(uint8_t* pixel, const uint8_t* frame, uint32_t source)
+{
+    const uint8_t* rgb = frame + LED_STRIP_FRAME_CHANNELS * source;
+#if CONFIG_TURBO_INPUT_RGBW
+    pixel[0] = rgb[1];
+    pixel[1] = rgb[0];
+    pixel[2] = rgb[2];
+    pixel[3] = rgb[3];
+#else
+    store_rgb(pixel, rgb);
+#endif
+}
+
+static inline void show_pixel_rgb565(uint8_t* pixel, const uint8_t* frame, uint32_t source)
+{
+    uint8_t rgb[3];
+    pixel_expand_rgb565(frame, source, rgb);
+    store_rgb(pixel, rgb);
+}
+
+static inline void show_pixel_palette8(uint8_t* pixel, const uint8_t* frame, uint32_t source)
+{
+    uint8_t rgb[3];
+    pixel_expand_palette8(frame, source, s_palette, rgb);
+    store_rgb(pixel, rgb);
+}
+
+static inline void show_pixel_hsv(uint8_t* pixel, const uint8_t* frame, uint32_t source)
+{
+    uint8_t rgb[3];
+    pixel_expand_hsv(frame, source, rgb);
+    store_rgb(pixel, rgb);
+}
+
+// Loop of show_frame() with the writer of one format, expanded once per format
+#define SHOW_FRAME_LOOP(show_pixel)                                                             \
+    for (uint32_t i = 0; i < LED_STRIP_LED_NUMBERS; ++i, pixel += LED_STRIP_BYTES_PER_PIXEL) { \
+        const uint16_t source = s_layout_lut[i];                                               \
+        if (source == LAYOUT_UNMAPPED) {                                                       \
+            memset(pixel, 0, LED_STRIP_BYTES_PER_PIXEL);                                       \
+            continue;                                                                          \
+        }                                                                                      \
+        show_pixel(pixel, frame, source);                                                      \
+        channel_sum += pixel_sum(pixel);                                                       \
+    }
+
+// Converts a frame in logical order into the GRB(W) pixel buffer in physical order.
+// Returns the sum of the bytes written, for the power limiter. The format is resolved
+// once per frame: each one has its own loop.
+static uint32_t show_frame(const uint8_t* frame, pixel_format_t format)
+{
+    uint32_t channel_sum = 0;
+    uint8_t* pixel = s_led_strip_pixels;
+    switch (format) {
+    case PIXEL_FORMAT_NATIVE:
+        SHOW_FRAME_LOOP(show_pixel_native);
+        break;
+    case PIXEL_FORMAT_RGB565:
+        SHOW_FRAME_LOOP(show_pixel_rgb565);
+        break;
+    case PIXEL_FORMAT_PALETTE8:
+        SHOW_FRAME_LOOP(show_pixel_palette8);
+        break;
+    case PIXEL_FORMAT_HSV:
+        SHOW_FRAME_LOOP(show_pixel_hsv);
+        break;
+    default:
+        memset(s_led_strip_pixels, 0, LED_STRIP_LED_NUMBERS * LED_STRIP_BYTES_PER_PIXEL);
+        break;
+    }
+    return channel_sum;
+}
+
+// Pixel writer of the audio renderer
+static void write_pixel(uint32_t index, uint8_t red, uint8_t green, uint8_t blue)
+{
+    const uint8_t rgb[3] = {red, green, blue};
+    store_rgb(s_led_strip_pixels + index * LED_STRIP_BYTES_PER_PIXEL, rgb);
+}
+
+// For content written pixel by pixel, which has no running sum
+static uint32_t pixel_buffer_sum(void)
+{
+    uint32_t channel_sum = 0;
+    for (size_t i = 0; i < LED_STRIP_LED_NUMBERS * LED_STRIP_BYTES_PER_PIXEL; ++i) {
+        channel_sum += s_led_strip_pixels[i];
+    }
+    return channel_sum;
+}
+
+static void limit_power(uint32_t channel_sum)
+{
+    const uint32_t estimate_ma = power_estimate_ma(&LED_STRIP_POWER_LIMIT, channel_sum, LED_STRIP_LED_NUMBERS);
+    s_ledstrip_stats.current_sum_ma += estimate_ma;
+    s_ledstrip_stats.current_count++;
+    if (estimate_ma > s_ledstrip_stats.current_max_ma) {
+        s_ledstrip_stats.current_max_ma = estimate_ma;
+    }
+    if (power_limit(&LED_STRIP_POWER_LIMIT, s_led_strip_pixels, LED_STRIP_LED_NUMBERS * LED_STRIP_BYTES_PER_PIXEL,
+                    estimate_ma, LED_STRIP_LED_NUMBERS)) {
+        ++s_ledstrip_stats.frames_limited;
+    }
+}
+
+// Hash of the pixels latched by the last refresh
+static uint32_t s_latched_hash = 0;
+static int64_t s_last_refresh_us = 0;
+
+// Hands the pixel buffer to the driver. The RMT driver and the streaming SPI backend
+// read it directly, the other SPI modes and the parallel backend copy every pixel.
+static void commit_pixels(led_strip_handle_t led_strip)
+{
+#if (CONFIG_TURBO_LED_BACKEND_SPI && !CONFIG_TURBO_LED_SPI_STREAM) || CONFIG_TURBO_LED_BACKEND_PARALLEL
+    const uint8_t* pixel = s_led_strip_pixels;
+    for (uint32_t i = 0; i < LED_STRIP_LED_NUMBERS; ++i, pixel += LED_STRIP_BYTES_PER_PIXEL) {
+#if CONFIG_TURBO_LED_RGBW
+        ESP_ERROR_CHECK(led_strip_set_pixel_rgbw(led_strip, i, pixel[1], pixel[0], pixel[2], pixel[3]));
+#else
+        ESP_ERROR_CHECK(led_strip_set_pixel(led_strip, i, pixel[1], pixel[0], pixel[2]));
+#endif
+    }
+#endif
+}
+
+static void refresh(led_strip_handle_t led_strip, uint32_t hash)
+{
+    TRACE_BEGIN(TRACE_COMMIT_PIXELS);
+    commit_pixels(led_strip);
+    TRACE_END(TRACE_COMMIT_PIXELS, 0);
+    const int64_t refresh_start_us = esp_timer_get_time();
+    TRACE_BEGIN(TRACE_REFRESH);
+    ESP_ERROR_CHECK(led_strip_refresh(led_strip));
+    TRACE_END(TRACE_REFRESH, 0);
+    const int64_t refresh_us = esp_timer_get_time() - refresh_start_us;
+    s_ledstrip_stats.refresh_sum_us += refresh_us;
+    s_ledstrip_stats.refresh_count++;
+    if (refresh_us > s_ledstrip_stats.refresh_max_us) {
+        s_ledstrip_stats.refresh_max_us = refresh_us;
+    }
+    s_latched_hash = hash;
+    s_last_refresh_us = esp_timer_get_time();
+}
+
+// Refreshes the strip unless the pixel buffer matches what is already latched. The
+// ROM CRC over the final buffer also covers the limiter and the audio renderer.
+static void refresh_if_changed(led_strip_handle_t led_strip)
+{
+    const uint32_t hash = esp_rom_crc32_le(0, s_led_strip_pixels, LED_STRIP_LED_NUMBERS * LED_STRIP_BYTES_PER_PIXEL);
+    if (hash == s_latched_hash && esp_timer_get_time() - s_last_refresh_us < LED_STRIP_KEEPALIVE_PERIOD_US) {
+        ++s_ledstrip_stats.refreshes_skipped;
+        return;
+    }
+    refresh(led_strip, hash);
+}
+
+static void load_startup_frame(uint8_t* frame, size_t frame_size)
+{
+    nvs_handle_t handle;
+    if (nvs_open(LED_STRIP_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        size_t size = frame_size;
+        const esp_err_t err = nvs_get_blob(handle, LED_STRIP_NVS_STARTUP_FRAME_KEY, frame, &size);
+        nvs_close(handle);
+        if (err == ESP_OK && size == frame_size) {
+            return;
+        }
+    }
+    ESP_LOGI(TAG, "No stored startup frame, using the default color");
+    for (size_t i = 0; i + LED_STRIP_FRAME_CHANNELS <= frame_size; i += LED_STRIP_FRAME_CHANNELS) {
+        memcpy(frame + i, LED_STRIP_STARTUP_COLOR, LED_STRIP_FRAME_CHANNELS);
+    }
+}
+
+// Shows the startup frame, borrowing a buffer from the pool: nothing has been received yet.
+static void show_startup_frame(ledstrip_pipeline_t* pipeline, led_strip_handle_t led_strip)
+{
+    uint8_t* frame = ledstrip_pipeline_acquire_frame(pipeline);
+    load_startup_frame(frame, pipeline->frame_size);
+    limit_power(show_frame(frame, PIXEL_FORMAT_NATIVE));
+    ledstrip_pipeline_release_frame(pipeline, frame);
+    refresh(led_strip, esp_rom_crc32_le(0, s_led_strip_pixels, LED_STRIP_LED_NUMBERS * LED_STRIP_BYTES_PER_PIXEL));
+    boot_phase_record(BOOT_PHASE_FIRST_FRAME);
+}
+
+static void record_copy(pixel_format_t format, int64_t copy_us)
+{
+    s_ledstrip_stats.copy_sum_us[format] += copy_us;
+    s_ledstrip_stats.copy_count[format]++;
+    if (copy_us > s_ledstrip_stats.copy_max_us[format]) {
+        s_ledstrip_stats.copy_max_us[format] = copy_us;
+    }
+}
+
+static void record_latency(ledstrip_message_type_t type, int64_t latency_us)
+{
+    s_ledstrip_stats.latency_sum_us[type] += latency_us;
+    s_ledstrip_stats.latency_count[type]++;
+    if (latency_us > s_ledstrip_stats.latency_max_us[type]) {
+        s_ledstrip_stats.latency_max_us[type] = latency_us;
+    }
+}
+
+static void report_latency(const char* name, ledstrip_message_type_t type)
+{
+    const uint32_t count = s_ledstrip_stats.latency_count[type];
+    if (count == 0) {
+        return;
+    }
+    ESP_LOGI(TAG, "%s latency over %" PRIu32 " messages: avg %" PRId64 " us, max %" PRId64 " us",
+             name, count, s_ledstrip_stats.latency_sum_us[type] / count, s_ledstrip_stats.latency_max_us[type]);
+    s_ledstrip_stats.latency_sum_us[type] = 0;
+    s_ledstrip_stats.latency_max_us[type] = 0;
+    s_ledstrip_stats.latency_count[type] = 0;
+}
+
+static void report_stats(void)
+{
+    static int64_t last_report_us = 0;
+    const int64_t now_us = esp_timer_get_time();
+    if (now_us - last_report_us < LED_STRIP_STATS_PERIOD_US) {
+        return;
+    }
+    last_report_us = now_us;
+    ESP_LOGI(TAG, "frames shown: %" PRIu32 ", skipped: %" PRIu32 ", unchanged: %" PRIu32 ", keep-alive refreshes: %" PRIu32,
+             s_ledstrip_stats.frames_shown, s_ledstrip_stats.frames_skipped,
+             s_ledstrip_stats.refreshes_skipped, s_ledstrip_stats.keepalive_refreshes);
+    for (int format = 0; format < PIXEL_FORMAT_COUNT; ++format) {
+        if (s_ledstrip_stats.copy_count[format] == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "frame copy (%s): avg %" PRId64 " us, max %" PRId64 " us", PIXEL_FORMAT_NAMES[format],
+                 s_ledstrip_stats.copy_sum_us[format] / s_ledstrip_stats.copy_count[format],
+                 s_ledstrip_stats.copy_max_us[format]);
+        s_ledstrip_stats.copy_sum_us[format] = 0;
+        s_ledstrip_stats.copy_max_us[format] = 0;
+        s_ledstrip_stats.copy_count[format] = 0;
+    }
+    if (s_ledstrip_stats.current_count != 0) {
+        ESP_LOGI(TAG, "estimated current: avg %" PRIu32 " mA, max %" PRIu32 " mA, limited %" PRIu32 "/%" PRIu32 " frames",
+                 (uint32_t) (s_ledstrip_stats.current_sum_ma / s_ledstrip_stats.current_count),
+                 s_ledstrip_stats.current_max_ma, s_ledstrip_stats.frames_limited, s_ledstrip_stats.current_count);
+        s_ledstrip_stats.current_sum_ma = 0;
+        s_ledstrip_stats.current_max_ma = 0;
+        s_ledstrip_stats.current_count = 0;
+        s_ledstrip_stats.frames_limited = 0;
+    }
+    if (s_ledstrip_stats.refresh_count != 0) {
+        ESP_LOGI(TAG, "refresh blocking: avg %" PRId64 " us, max %" PRId64 " us",
+                 s_ledstrip_stats.refresh_sum_us / s_ledstrip_stats.refresh_count, s_ledstrip_stats.refresh_max_us);
+        s_ledstrip_stats.refresh_sum_us = 0;
+        s_ledstrip_stats.refresh_max_us = 0;
+        s_ledstrip_stats.refresh_count = 0;
+    }
+    report_latency("frame", LEDSTRIP_MESSAGE_FRAME);
+    report_latency("audio", LEDSTRIP_MESSAGE_AUDIO);
+}
+
 void ledstrip_task(void *pvParameters)
 {
-    QueueHandle_t* queue_handle = (QueueHandle_t*) pvParameters;
+    ledstrip_pipeline_t* pipeline = (ledstrip_pipeline_t*) pvParameters;
     led_strip_handle_t led_strip = configure_led();
+    show_startup_frame(pipeline, led_strip);
 
     ESP_LOGI(TAG, "Start blinking LED strip");
-    uint8_t buffer[3];
-    size_t current_pixel = 0;
+    ledstrip_message_t message;
     while (true) {
-        if (!xQueueReceive(*queue_handle, &buffer, 5)) {
+        if (!xQueueReceive(pipeline->messages, &message, pdMS_TO_TICKS(LED_STRIP_KEEPALIVE_PERIOD_US / 1000))) {
+            // Nothing received, re-send the latched pixels
+            refresh(led_strip, s_latched_hash);
+            ++s_ledstrip_stats.keepalive_refreshes;
+            report_stats();
             continue;
         }
+        TRACE_INSTANT(TRACE_FRAME_DEQUEUED, message.type);
+        if (LED_STRIP_DROP_STALE_FRAMES) {
+            skip_stale_messages(pipeline, &message);
+        }
 
-        const uint8_t r = buffer[0];
-        const uint8_t g = buffer[1];
-        const uint8_t b = buffer[2];
-        ESP_ERROR_CHECK(led_strip_set_pixel(led_strip, current_pixel++, r, g, b));
-        if (current_pixel == LED_STRIP_LED_NUMBERS) {
-            current_pixel = 0;
-            ESP_ERROR_CHECK(led_strip_refresh(led_strip));
+        switch (message.type) {
+        case LEDSTRIP_MESSAGE_FRAME: {
+            const int64_t copy_start_us = esp_timer_get_time();
+            TRACE_BEGIN(TRACE_SHOW_FRAME);
+            const uint32_t channel_sum = show_frame(message.frame, message.format);
+            TRACE_END(TRACE_SHOW_FRAME, message.format);
+            limit_power(channel_sum);
+            record_copy(message.format, esp_timer_get_time() - copy_start_us);
+            ledstrip_pipeline_release_frame(pipeline, message.frame);
+            ++s_ledstrip_stats.frames_shown;
+            break;
         }
+        case LEDSTRIP_MESSAGE_AUDIO:
+            audio_render(write_pixel, LED_STRIP_LED_NUMBERS, &message.audio);
+            limit_power(pixel_buffer_sum());
+            break;
+        case LEDSTRIP_MESSAGE_PALETTE:
+            // Nothing to show until a frame uses it
+            memcpy(s_palette, message.frame, PIXEL_PALETTE_SIZE);
+            ledstrip_pipeline_release_frame(pipeline, message.frame);
+            continue;
+        default:
+            continue;
+        }
+
+        refresh_if_changed(led_strip);
+        boot_phase_record(BOOT_PHASE_FIRST_NETWORK_FRAME);
+        record_latency(message.type, esp_timer_get_time() - message.received_us);
+        report_stats();
     }
 }
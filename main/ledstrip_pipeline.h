@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "frame_store.h"
+#include "pixel_format.h"
+
+// Maximum number of band energies carried by an audio features message
+#define AUDIO_MAX_BANDS 16
+// Receivers that may each hold a frame buffer while they fill it: the TCP server, the
+// WebSocket server unless CONFIG_TURBO_FRAME_AUTH, the multicast receiver
+#if CONFIG_TURBO_FRAME_AUTH
+#define LEDSTRIP_FRAME_PRODUCERS 1
+#elif CONFIG_TURBO_MULTICAST
+#define LEDSTRIP_FRAME_PRODUCERS 3
+#else
+#define LEDSTRIP_FRAME_PRODUCERS 2
+#endif
+// Number of frame buffers circulating between the producers and the consumer: one per
+// producer, and two queued or being shown
+#define LEDSTRIP_FRAME_POOL_SIZE (LEDSTRIP_FRAME_PRODUCERS + 2)
+#define LEDSTRIP_MESSAGE_QUEUE_SIZE (LEDSTRIP_FRAME_POOL_SIZE + 2)
+
+typedef enum {
+    LEDSTRIP_MESSAGE_FRAME,   // A complete pixel frame, pixels in logical order
+    LEDSTRIP_MESSAGE_AUDIO,   // Audio features rendered on the device
+    LEDSTRIP_MESSAGE_PALETTE, // New palette of the PIXEL_FORMAT_PALETTE8 frames that follow
+    LEDSTRIP_MESSAGE_TYPE_COUNT,
+} ledstrip_message_type_t;
+
+typedef struct {
+    uint8_t band_count;
+    uint8_t beat;
+    uint8_t bands[AUDIO_MAX_BANDS];
+} audio_features_t;
+
+typedef struct {
+    ledstrip_message_type_t type;
+    // esp_timer timestamp of the moment the message was fully received
+    int64_t received_us;
+    union {
+        // LEDSTRIP_MESSAGE_FRAME and LEDSTRIP_MESSAGE_PALETTE, a buffer of the pool
+        struct {
+            uint8_t* frame;
+            pixel_format_t format; // LEDSTRIP_MESSAGE_FRAME only
+        };
+        audio_features_t audio;
+    };
+} ledstrip_message_t;
+
+typedef struct {
+    QueueHandle_t messages;    // Producer -> consumer
+    QueueHandle_t free_frames; // Consumer -> producer, recycled frame buffers
+    size_t frame_size;
+#if CONFIG_TURBO_STATIC_PIPELINE
+    StaticQueue_t messages_queue;
+    StaticQueue_t free_frames_queue;
+    uint8_t messages_storage[LEDSTRIP_MESSAGE_QUEUE_SIZE * sizeof(ledstrip_message_t)];
+    uint8_t free_frames_storage[LEDSTRIP_FRAME_POOL_SIZE * sizeof(uint8_t*)];
+#endif
+} ledstrip_pipeline_t;
+
+// frame_storage holds LEDSTRIP_FRAME_POOL_SIZE frames of frame_size bytes. When NULL,
+// the frames are allocated from the frame store.
+static esp_err_t ledstrip_pipeline_init(ledstrip_pipeline_t* pipeline, size_t frame_size, uint8_t* frame_storage)
+{
+    pipeline->frame_size = frame_size;
+#if CONFIG_TURBO_STATIC_PIPELINE
+    pipeline->messages = xQueueCreateStatic(LEDSTRIP_MESSAGE_QUEUE_SIZE, sizeof(ledstrip_message_t),
+                                            pipeline->messages_storage, &pipeline->messages_queue);
+    pipeline->free_frames = xQueueCreateStatic(LEDSTRIP_FRAME_POOL_SIZE, sizeof(uint8_t*),
+                                               pipeline->free_frames_storage, &pipeline->free_frames_queue);
+#else
+    pipeline->messages = xQueueCreate(LEDSTRIP_MESSAGE_QUEUE_SIZE, sizeof(ledstrip_message_t));
+    pipeline->free_frames = xQueueCreate(LEDSTRIP_FRAME_POOL_SIZE, sizeof(uint8_t*));
+#endif
+    if (pipeline->messages == NULL || pipeline->free_frames == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (frame_storage == NULL) {
+        frame_storage = frame_store_calloc(LEDSTRIP_FRAME_POOL_SIZE, frame_size);
+        if (frame_storage == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    ESP_LOGI("pipeline", "%d frames of %u bytes in %s", LEDSTRIP_FRAME_POOL_SIZE, (unsigned) frame_size,
+             frame_store_location(frame_storage));
+
+    for (size_t i = 0; i < LEDSTRIP_FRAME_POOL_SIZE; ++i) {
+        uint8_t* frame = frame_storage + i * frame_size;
+        xQueueSend(pipeline->free_frames, &frame, 0);
+    }
+    return ESP_OK;
+}
+
+static uint8_t* ledstrip_pipeline_acquire_frame(ledstrip_pipeline_t* pipeline)
+{
+    uint8_t* frame = NULL;
+    xQueueReceive(pipeline->free_frames, &frame, portMAX_DELAY);
+    return frame;
+}
+
+static void ledstrip_pipeline_release_frame(ledstrip_pipeline_t* pipeline, uint8_t* frame)
+{
+    xQueueSend(pipeline->free_frames, &frame, 0);
+}
+
+// Releases the resources held by a message that will not be displayed.
+static void ledstrip_pipeline_release_message(ledstrip_pipeline_t* pipeline, const ledstrip_message_t* message)
+{
+    if (message->type == LEDSTRIP_MESSAGE_FRAME || message->type == LEDSTRIP_MESSAGE_PALETTE) {
+        ledstrip_pipeline_release_frame(pipeline, message->frame);
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Bookkeeping of the multicast receiver, kept apart from lwIP so that it can be tested
+// on the host: the byte ranges of a segment covered by the datagrams of a frame, and
+// the order of the frame sequence numbers.
+
+// Disjoint byte ranges of the segment tracked per frame, a datagram that would need more
+// is ignored
+#define MULTICAST_MAX_RANGES 8
+
+typedef struct {
+    uint32_t first;
+    uint32_t last; // Exclusive
+} multicast_range_t;
+
+// Parts of the segment received for a frame, sorted and disjoint
+typedef struct {
+    multicast_range_t ranges[MULTICAST_MAX_RANGES];
+    uint32_t count;
+} multicast_coverage_t;
+
+// Adds [first, last) to the covered ranges, merging the ranges it overlaps or touches.
+// Returns false, leaving the ranges as they were, when there is no room for a new one.
+static inline bool multicast_cover(multicast_coverage_t* coverage, uint32_t first, uint32_t last)
+{
+    multicast_range_t* ranges = coverage->ranges;
+    uint32_t begin = 0;
+    while (begin < coverage->count && ranges[begin].last < first) {
+        ++begin;
+    }
+    uint32_t end = begin;
+    while (end < coverage->count && ranges[end].first <= last) {
+        first = ranges[end].first < first ? ranges[end].first : first;
+        last = ranges[end].last > last ? ranges[end].last : last;
+        ++end;
+    }
+    if (begin == end) {
+        if (coverage->count == MULTICAST_MAX_RANGES) {
+            return false;
+        }
+        memmove(&ranges[begin + 1], &ranges[begin], (coverage->count - begin) * sizeof(ranges[0]));
+        ++coverage->count;
+    } else {
+        memmove(&ranges[begin + 1], &ranges[end], (coverage->count - end) * sizeof(ranges[0]));
+        coverage->count -= end - begin - 1;
+    }
+    ranges[begin] = (multicast_range_t) {.first = first, .last = last};
+    return true;
+}
+
+// The whole segment [0, size) has been received
+static inline bool multicast_covered(const multicast_coverage_t* coverage, uint32_t size)
+{
+    return coverage->count == 1 && coverage->ranges[0].first == 0 && coverage->ranges[0].last == size;
+}
+
+// How many sequences sequence is behind current, negative when it is ahead. Serial
+// number arithmetic: the 16-bit sequence wraps around.
+static inline int16_t multicast_sequence_age(uint16_t current, uint16_t sequence)
+{
+    return (int16_t) (uint16_t) (current - sequence);
+}
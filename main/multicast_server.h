@@ -0,0 +1,228 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/igmp.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
+#include "lwip/udp.h"
+#include "ledstrip_pipeline.h"
+#include "multicast_coverage.h"
+
+// Multicast receive mode, enabled by CONFIG_TURBO_MULTICAST. A controller sends one
+// stream of datagrams to a multicast group for all the boards. The stream carries
+// multi-board frames of native pixels, and each board shows the
+// LED_STRIP_LED_NUMBERS pixels starting at CONFIG_TURBO_MULTICAST_PIXEL_OFFSET.
+//
+// Datagram layout, little endian:
+//   byte 0: protocol version (MULTICAST_PACKET_VERSION)
+//   byte 1: reserved, 0
+//   byte 2..3: frame sequence number, the same for all the datagrams of a frame
+//   byte 4..7: offset in the multi-board frame, in bytes, of the payload
+//   byte 8..: payload
+//
+// The datagrams are handled by a raw lwIP callback in the tcpip thread, on the pbuf
+// chain itself: only the bytes of this board's segment are copied, straight into a
+// frame buffer of the pipeline, and the rest of the datagram is never touched. The byte
+// ranges of the segment covered so far are tracked, so duplicated, overlapping and
+// reordered datagrams are harmless, and a frame is queued as soon as they cover the
+// whole segment. A segment left incomplete when a newer sequence number shows up is
+// dropped; datagrams of older sequences are ignored. The frame buffer is only held
+// while a segment is assembled: it goes back to the pool when the segment is dropped,
+// or when no datagram has come for MULTICAST_IDLE_TIMEOUT_MS.
+#if CONFIG_TURBO_MULTICAST
+static const char *TAG_MULTICAST = "multicast";
+static const uint8_t MULTICAST_PACKET_VERSION = 1;
+#define MULTICAST_PACKET_HEADER_SIZE 8
+// A sequence further behind the current one than this is taken as a controller restart
+static const int16_t MULTICAST_SEQUENCE_WINDOW = 64;
+// Interval between two statistics reports, in microseconds
+static const int64_t MULTICAST_STATS_PERIOD_US = 5 * 1000 * 1000;
+// Silence after which the stream is taken as stopped, checked at this interval too
+#define MULTICAST_IDLE_TIMEOUT_MS 500
+
+typedef struct {
+    ledstrip_pipeline_t* pipeline;
+    // This board's segment of the multi-board frame, in bytes
+    uint32_t segment_start;
+    uint32_t segment_size;
+    // Frame being assembled, NULL when no buffer is held
+    uint8_t* frame;
+    bool started; // A sequence has been received
+    uint16_t sequence;
+    // Parts of the segment received for the current sequence, relative to its start
+    multicast_coverage_t coverage;
+    bool completed; // The current sequence has been queued already
+    int64_t last_datagram_us;
+    // Reset on every report
+    int64_t stats_start_us;
+    uint32_t datagrams;
+    uint32_t datagrams_ignored;
+    uint32_t datagrams_late;
+    uint32_t frames;
+    uint32_t frames_incomplete;
+    uint32_t frames_dropped;
+} multicast_receiver_t;
+
+static multicast_receiver_t s_multicast;
+
+static void multicast_report_stats(multicast_receiver_t* receiver)
+{
+    const int64_t now_us = esp_timer_get_time();
+    if (now_us - receiver->stats_start_us < MULTICAST_STATS_PERIOD_US) {
+        return;
+    }
+    ESP_LOGI(TAG_MULTICAST, "%" PRIu32 " datagrams, %" PRIu32 " ignored, %" PRIu32 " late, %" PRIu32 " frames, %" PRIu32 " incomplete, %" PRIu32 " dropped",
+             receiver->datagrams, receiver->datagrams_ignored, receiver->datagrams_late, receiver->frames,
+             receiver->frames_incomplete, receiver->frames_dropped);
+    receiver->stats_start_us = now_us;
+    receiver->datagrams = 0;
+    receiver->datagrams_ignored = 0;
+    receiver->datagrams_late = 0;
+    receiver->frames = 0;
+    receiver->frames_incomplete = 0;
+    receiver->frames_dropped = 0;
+}
+
+// Gives up the segment being assembled and returns its buffer to the pool
+static void multicast_drop_frame(multicast_receiver_t* receiver)
+{
+    if (!receiver->completed && receiver->coverage.count > 0) {
+        ++receiver->frames_incomplete;
+    }
+    if (receiver->frame != NULL) {
+        ledstrip_pipeline_release_frame(receiver->pipeline, receiver->frame);
+        receiver->frame = NULL;
+    }
+    receiver->coverage.count = 0;
+}
+
+static void multicast_start_frame(multicast_receiver_t* receiver, uint16_t sequence)
+{
+    multicast_drop_frame(receiver);
+    receiver->started = true;
+    receiver->sequence = sequence;
+    receiver->completed = false;
+}
+
+// lwIP timeout, in the tcpip thread like multicast_recv(): frees the buffer of a
+// stream that stopped, the next datagram starts a new sequence whatever its number
+static void multicast_idle_check(void* arg)
+{
+    multicast_receiver_t* receiver = (multicast_receiver_t*) arg;
+    if (receiver->started && esp_timer_get_time() - receiver->last_datagram_us >= MULTICAST_IDLE_TIMEOUT_MS * 1000) {
+        multicast_drop_frame(receiver);
+        receiver->started = false;
+    }
+    sys_timeout(MULTICAST_IDLE_TIMEOUT_MS, multicast_idle_check, receiver);
+}
+
+// Runs in the tcpip thread: never blocks on the pipeline
+static void multicast_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    multicast_receiver_t* receiver = (multicast_receiver_t*) arg;
+    uint8_t header[MULTICAST_PACKET_HEADER_SIZE];
+    ++receiver->datagrams;
+    receiver->last_datagram_us = esp_timer_get_time();
+    if (pbuf_copy_partial(p, header, sizeof(header), 0) != sizeof(header) || header[0] != MULTICAST_PACKET_VERSION) {
+        ++receiver->datagrams_ignored;
+        goto done;
+    }
+    const uint16_t sequence = header[2] | header[3] << 8;
+    const uint32_t offset = header[4] | header[5] << 8 | header[6] << 16 | (uint32_t) header[7] << 24;
+    const uint32_t length = p->tot_len - MULTICAST_PACKET_HEADER_SIZE;
+    const int16_t age = multicast_sequence_age(receiver->sequence, sequence);
+    if (!receiver->started || age < 0 || age > MULTICAST_SEQUENCE_WINDOW) {
+        multicast_start_frame(receiver, sequence);
+    } else if (age > 0) {
+        // Reordered datagram of a frame already completed or given up
+        ++receiver->datagrams_late;
+        goto done;
+    }
+
+    // Part of the payload that falls in this board's segment
+    const uint32_t start = receiver->segment_start;
+    const uint32_t segment_end = start + receiver->segment_size;
+    const uint32_t first = offset > start ? offset : start;
+    const uint32_t last = offset + length < segment_end ? offset + length : segment_end;
+    if (first >= last || receiver->completed) {
+        ++receiver->datagrams_ignored;
+        goto done;
+    }
+
+    if (receiver->frame == NULL && xQueueReceive(receiver->pipeline->free_frames, &receiver->frame, 0) != pdTRUE) {
+        // The LED task is behind, this frame is lost
+        receiver->frame = NULL;
+        receiver->completed = true;
+        ++receiver->frames_dropped;
+        goto done;
+    }
+    if (!multicast_cover(&receiver->coverage, first - start, last - start)) {
+        ++receiver->datagrams_ignored;
+        goto done;
+    }
+    pbuf_copy_partial(p, receiver->frame + (first - start), last - first, MULTICAST_PACKET_HEADER_SIZE + (first - offset));
+    if (multicast_covered(&receiver->coverage, receiver->segment_size)) {
+        const ledstrip_message_t message = {
+            .type = LEDSTRIP_MESSAGE_FRAME,
+            .received_us = esp_timer_get_time(),
+            .frame = receiver->frame,
+        };
+        if (xQueueSend(receiver->pipeline->messages, &message, 0) == pdTRUE) {
+            receiver->frame = NULL;
+            ++receiver->frames;
+        } else {
+            ++receiver->frames_dropped;
+            ledstrip_pipeline_release_frame(receiver->pipeline, receiver->frame);
+            receiver->frame = NULL;
+        }
+        receiver->completed = true;
+    }
+
+done:
+    multicast_report_stats(receiver);
+    pbuf_free(p);
+}
+
+static void multicast_server_setup(void* ctx)
+{
+    multicast_receiver_t* receiver = (multicast_receiver_t*) ctx;
+    ip4_addr_t group;
+    if (!ip4addr_aton(CONFIG_TURBO_MULTICAST_GROUP, &group) || !ip4_addr_ismulticast(&group)) {
+        ESP_LOGE(TAG_MULTICAST, "Invalid multicast group %s", CONFIG_TURBO_MULTICAST_GROUP);
+        return;
+    }
+    struct udp_pcb* pcb = udp_new();
+    if (pcb == NULL) {
+        ESP_LOGE(TAG_MULTICAST, "Unable to create the UDP PCB");
+        return;
+    }
+    if (udp_bind(pcb, IP_ADDR_ANY, CONFIG_TURBO_MULTICAST_PORT) != ERR_OK) {
+        ESP_LOGE(TAG_MULTICAST, "Unable to bind port %d", CONFIG_TURBO_MULTICAST_PORT);
+        udp_remove(pcb);
+        return;
+    }
+    // Joins on every interface up at this point
+    if (igmp_joingroup(IP4_ADDR_ANY4, &group) != ERR_OK) {
+        ESP_LOGE(TAG_MULTICAST, "Unable to join %s", CONFIG_TURBO_MULTICAST_GROUP);
+        udp_remove(pcb);
+        return;
+    }
+    udp_recv(pcb, multicast_recv, receiver);
+    sys_timeout(MULTICAST_IDLE_TIMEOUT_MS, multicast_idle_check, receiver);
+    ESP_LOGI(TAG_MULTICAST, "Listening on %s:%d, segment of %" PRIu32 " bytes at offset %" PRIu32,
+             CONFIG_TURBO_MULTICAST_GROUP, CONFIG_TURBO_MULTICAST_PORT, receiver->segment_size, receiver->segment_start);
+}
+
+static esp_err_t multicast_server_start(ledstrip_pipeline_t* pipeline)
+{
+    s_multicast = (multicast_receiver_t) {
+        .pipeline = pipeline,
+        .segment_start = CONFIG_TURBO_MULTICAST_PIXEL_OFFSET * PIXEL_FORMAT_BYTES[PIXEL_FORMAT_NATIVE],
+        .segment_size = pipeline->frame_size,
+        .stats_start_us = esp_timer_get_time(),
+    };
+    // The raw UDP API may only be used from the tcpip thread
+    return tcpip_callback(multicast_server_setup, &s_multicast) == ERR_OK ? ESP_OK : ESP_FAIL;
+}
+#endif
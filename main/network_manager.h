@@ -0,0 +1,460 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "esp_wifi.h"
+#include "esp_eth.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "ethernet_init.h"
+#include "network_stats.h"
+
+static const char *TAG_NETWORK = "network";
+
+static const char EXAMPLE_ESP_WIFI_SSID[] = "Suziass\0\0\0";
+static const char EXAMPLE_ESP_WIFI_PASS[] = "Assuzie789\0\0";
+
+// Both interfaces are brought up. Ethernet is preferred whenever it has an IP, Wi-Fi
+// takes over as soon as the Ethernet link drops.
+typedef enum {
+    NETWORK_INTERFACE_ETH,
+    NETWORK_INTERFACE_WIFI,
+    NETWORK_INTERFACE_COUNT,
+} network_interface_t;
+
+static const char* const NETWORK_INTERFACE_NAMES[NETWORK_INTERFACE_COUNT] = {"ethernet", "wifi"};
+// Route priority of the Ethernet netif, above the Wi-Fi station default (100) so that
+// esp_netif keeps Ethernet as the default route while it is up
+static const int NETWORK_ETH_ROUTE_PRIO = 200;
+
+// Called from the event loop when an interface that had an IP loses its link, with
+// that IPv4 address (network byte order). Used to drop the connections bound to it.
+typedef void (*network_link_lost_cb_t)(uint32_t ip_addr);
+
+typedef struct {
+    esp_netif_t* netif;
+    bool has_ip;
+    uint32_t ip_addr;
+} network_interface_state_t;
+
+static network_interface_state_t s_network_interfaces[NETWORK_INTERFACE_COUNT];
+static network_interface_t s_network_active = NETWORK_INTERFACE_COUNT;
+static network_link_lost_cb_t s_network_link_lost_cb = NULL;
+
+/* FreeRTOS event group to signal which interfaces have an IP, one bit per network_interface_t */
+static EventGroupHandle_t s_network_event_group;
+
+static int s_retry_num = 0;
+
+// Wi-Fi reconnection never gives up: attempts are spaced by an exponential backoff
+// with jitter, starting with an immediate retry on the cached access point.
+static const int64_t WIFI_RECONNECT_MIN_DELAY_US = 100 * 1000;
+static const int64_t WIFI_RECONNECT_MAX_DELAY_US = 10 * 1000 * 1000;
+static const char* NETWORK_NVS_NAMESPACE = "network";
+static const char* WIFI_AP_CACHE_KEY = "wifi_ap";
+
+// Last access point we associated with. Targeting its BSSID on its channel skips the
+// full scan, which costs seconds on busy venue networks. The IP lease itself is
+// restored by lwIP (CONFIG_LWIP_DHCP_RESTORE_LAST_IP).
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+} wifi_ap_cache_t;
+
+typedef struct {
+    int64_t disconnected_us; // Start of the current outage, 0 while connected
+    uint32_t reconnects;
+    int64_t sum_us;
+    int64_t max_us;
+} wifi_reconnect_stats_t;
+
+static wifi_ap_cache_t s_wifi_ap_cache;
+static bool s_wifi_ap_cached = false;
+static esp_timer_handle_t s_wifi_reconnect_timer;
+static wifi_reconnect_stats_t s_wifi_reconnect_stats;
+
+static void wifi_load_ap_cache(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open(NETWORK_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    size_t size = sizeof(s_wifi_ap_cache);
+    s_wifi_ap_cached = nvs_get_blob(handle, WIFI_AP_CACHE_KEY, &s_wifi_ap_cache, &size) == ESP_OK
+                       && size == sizeof(s_wifi_ap_cache);
+    nvs_close(handle);
+}
+
+static void wifi_store_ap_cache(const uint8_t* bssid, uint8_t channel)
+{
+    if (s_wifi_ap_cached && s_wifi_ap_cache.channel == channel
+            && memcmp(s_wifi_ap_cache.bssid, bssid, sizeof(s_wifi_ap_cache.bssid)) == 0) {
+        return;
+    }
+    memcpy(s_wifi_ap_cache.bssid, bssid, sizeof(s_wifi_ap_cache.bssid));
+    s_wifi_ap_cache.channel = channel;
+    s_wifi_ap_cached = true;
+
+    nvs_handle_t handle;
+    if (nvs_open(NETWORK_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        ESP_LOGW(TAG_NETWORK, "Failed to open NVS, access point not cached");
+        return;
+    }
+    if (nvs_set_blob(handle, WIFI_AP_CACHE_KEY, &s_wifi_ap_cache, sizeof(s_wifi_ap_cache)) == ESP_OK) {
+        nvs_commit(handle);
+    }
+    nvs_close(handle);
+}
+
+static void wifi_fill_config(wifi_config_t* wifi_config, bool use_ap_cache)
+{
+    *wifi_config = (wifi_config_t) {
+        .sta = {
+            .ssid = "",
+            .password = "",
+            /* Authmode threshold resets to WPA2 as default if password matches WPA2 standards (pasword len => 8).
+             * If you want to connect the device to deprecated WEP/WPA networks, Please set the threshold value
+             * to WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK and set the password with length and format matching to
+             * WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK standards.
+             */
+            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
+            .sae_pwe_h2e = WPA3_SAE_PWE_BOTH,
+            .sae_h2e_identifier = "\0",
+        },
+    };
+    memcpy(wifi_config->sta.ssid, EXAMPLE_ESP_WIFI_SSID, sizeof(EXAMPLE_ESP_WIFI_SSID));
+    memcpy(wifi_config->sta.password, EXAMPLE_ESP_WIFI_PASS, sizeof(EXAMPLE_ESP_WIFI_PASS));
+    if (use_ap_cache && s_wifi_ap_cached) {
+        wifi_config->sta.bssid_set = true;
+        memcpy(wifi_config->sta.bssid, s_wifi_ap_cache.bssid, sizeof(s_wifi_ap_cache.bssid));
+        wifi_config->sta.channel = s_wifi_ap_cache.channel;
+    }
+}
+
+static void wifi_apply_config(bool use_ap_cache)
+{
+    wifi_config_t wifi_config;
+    wifi_fill_config(&wifi_config, use_ap_cache);
+    esp_err_t err = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_NETWORK, "Failed to set wifi config: %s", esp_err_to_name(err));
+    }
+}
+
+static void wifi_reconnect_timer_cb(void* arg)
+{
+    esp_wifi_connect();
+}
+
+static int64_t wifi_reconnect_delay_us(int attempt)
+{
+    int64_t delay_us = WIFI_RECONNECT_MIN_DELAY_US;
+    for (int i = 1; i < attempt && delay_us < WIFI_RECONNECT_MAX_DELAY_US; ++i) {
+        delay_us *= 2;
+    }
+    if (delay_us > WIFI_RECONNECT_MAX_DELAY_US) {
+        delay_us = WIFI_RECONNECT_MAX_DELAY_US;
+    }
+    // Equal jitter: keep half of the delay, randomize the other half
+    return delay_us / 2 + esp_random() % (delay_us / 2 + 1);
+}
+
+static void wifi_schedule_reconnect(void)
+{
+    const int attempt = s_retry_num++;
+    // First attempt of an outage: straight to the cached access point.
+    // Second attempt: the cached one is gone, fall back to a full scan.
+    if (attempt == 0) {
+        wifi_apply_config(true);
+        esp_wifi_connect();
+        return;
+    }
+    if (attempt == 1 && s_wifi_ap_cached) {
+        wifi_apply_config(false);
+    }
+
+    const int64_t delay_us = wifi_reconnect_delay_us(attempt);
+    ESP_LOGI(TAG_NETWORK, "retry to connect to the AP in %" PRId64 " ms", delay_us / 1000);
+    esp_timer_stop(s_wifi_reconnect_timer);
+    esp_timer_start_once(s_wifi_reconnect_timer, delay_us);
+}
+
+static void wifi_record_reconnect(void)
+{
+    wifi_reconnect_stats_t* stats = &s_wifi_reconnect_stats;
+    if (stats->disconnected_us == 0) {
+        return;
+    }
+    const int64_t elapsed_us = esp_timer_get_time() - stats->disconnected_us;
+    stats->disconnected_us = 0;
+    ++stats->reconnects;
+    stats->sum_us += elapsed_us;
+    if (elapsed_us > stats->max_us) {
+        stats->max_us = elapsed_us;
+    }
+    ESP_LOGI(TAG_NETWORK, "Wi-Fi up after %" PRId64 " ms (avg %" PRId64 " ms, max %" PRId64 " ms over %" PRIu32 " connections)",
+             elapsed_us / 1000, stats->sum_us / stats->reconnects / 1000, stats->max_us / 1000, stats->reconnects);
+}
+
+static void network_select_active(void)
+{
+    network_interface_t selected = NETWORK_INTERFACE_COUNT;
+    for (int i = 0; i < NETWORK_INTERFACE_COUNT; ++i) {
+        if (s_network_interfaces[i].has_ip) {
+            selected = i;
+            break;
+        }
+    }
+    if (selected == s_network_active) {
+        return;
+    }
+
+    s_network_active = selected;
+    if (selected == NETWORK_INTERFACE_COUNT) {
+        ESP_LOGW(TAG_NETWORK, "No interface up, waiting for a link");
+        return;
+    }
+    esp_netif_set_default_netif(s_network_interfaces[selected].netif);
+    ESP_LOGI(TAG_NETWORK, "Active interface: %s", NETWORK_INTERFACE_NAMES[selected]);
+}
+
+// Link state machine, driven by the event handlers below.
+static void network_on_got_ip(network_interface_t interface, uint32_t ip_addr)
+{
+    s_network_interfaces[interface].has_ip = true;
+    s_network_interfaces[interface].ip_addr = ip_addr;
+    xEventGroupSetBits(s_network_event_group, BIT(interface));
+    network_select_active();
+}
+
+static void network_on_link_down(network_interface_t interface)
+{
+    network_interface_state_t* state = &s_network_interfaces[interface];
+    if (!state->has_ip) {
+        return;
+    }
+
+    ESP_LOGW(TAG_NETWORK, "Lost %s link", NETWORK_INTERFACE_NAMES[interface]);
+    state->has_ip = false;
+    xEventGroupClearBits(s_network_event_group, BIT(interface));
+    if (s_network_link_lost_cb) {
+        s_network_link_lost_cb(state->ip_addr);
+    }
+    network_select_active();
+}
+
+
+static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        s_wifi_reconnect_stats.disconnected_us = esp_timer_get_time();
+        esp_wifi_connect();
+        s_retry_num = 1;
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        wifi_event_sta_connected_t* event = (wifi_event_sta_connected_t*) event_data;
+        wifi_store_ap_cache(event->bssid, event->channel);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        ESP_LOGI(TAG_NETWORK,"connect to the AP fail");
+        if (s_wifi_reconnect_stats.disconnected_us == 0) {
+            s_wifi_reconnect_stats.disconnected_us = esp_timer_get_time();
+        }
+        network_on_link_down(NETWORK_INTERFACE_WIFI);
+        wifi_schedule_reconnect();
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
+        ESP_LOGI(TAG_NETWORK, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
+        s_retry_num = 0;
+        wifi_record_reconnect();
+        network_on_got_ip(NETWORK_INTERFACE_WIFI, event->ip_info.ip.addr);
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_LOST_IP) {
+        network_on_link_down(NETWORK_INTERFACE_WIFI);
+    }
+}
+
+// Starts the station and returns without waiting for the connection: the link state
+// is followed by wifi_event_handler().
+esp_err_t wifi_init_sta(void)
+{
+    s_network_interfaces[NETWORK_INTERFACE_WIFI].netif = esp_netif_create_default_wifi_sta();
+
+    const esp_timer_create_args_t reconnect_timer_args = {
+        .callback = wifi_reconnect_timer_cb,
+        .name = "wifi_reconnect",
+    };
+    esp_err_t err = esp_timer_create(&reconnect_timer_args, &s_wifi_reconnect_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_NETWORK, "Failed to create the reconnect timer.");
+        return err;
+    }
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    err = esp_wifi_init(&cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_NETWORK, "Failed to initialize wifi.");
+        return err;
+    }
+
+    err = esp_wifi_set_ps(WIFI_PS_NONE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_NETWORK, "Failed to set wifi power saving mode.");
+        return err;
+    }
+
+    esp_event_handler_instance_t instance_any_id;
+    esp_event_handler_instance_t instance_got_ip;
+    err = esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL, &instance_any_id);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_NETWORK, "Failed to configure wifi event handler instance register for any ids.");
+        return err;
+    }
+
+    err = esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL, &instance_got_ip);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_NETWORK, "Failed to configure wifi event handler for GOT_IP.");
+        return err;
+    }
+
+    esp_event_handler_instance_t instance_lost_ip;
+    err = esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_LOST_IP, &wifi_event_handler, NULL, &instance_lost_ip);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_NETWORK, "Failed to configure wifi event handler for LOST_IP.");
+        return err;
+    }
+
+    wifi_load_ap_cache();
+    wifi_config_t wifi_config;
+    wifi_fill_config(&wifi_config, true);
+
+    err = esp_wifi_set_mode(WIFI_MODE_STA);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_NETWORK, "Failed to set wifi mode.");
+        return err;
+    }
+
+    err = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_NETWORK, "Failed to set wifi config.");
+        return err;
+    }
+
+    err = esp_wifi_start();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_NETWORK, "Failed to start wifi.");
+        return err;
+    }
+
+    ESP_LOGI(TAG_NETWORK, "wifi_init_sta finished.");
+
+    return ESP_OK;
+}
+
+
+void eth_event_handler_pipi(void* args, esp_event_base_t even_base, int32_t event_id, void* event_data) {
+    if (even_base == ETH_EVENT) {
+        if (event_id == ETHERNET_EVENT_DISCONNECTED) {
+            network_on_link_down(NETWORK_INTERFACE_ETH);
+        }
+        return;
+    }
+
+    if (event_id == IP_EVENT_ETH_LOST_IP) {
+        network_on_link_down(NETWORK_INTERFACE_ETH);
+        return;
+    }
+
+    ip_event_got_ip_t* event = (ip_event_got_ip_t*)event_data;
+    const esp_netif_ip_info_t* ip_info = &event->ip_info;
+    ESP_LOGI("ETHERNET", "IP: " IPSTR, IP2STR(&ip_info->ip));
+    ESP_LOGI("ETHERNET", "NETMASK: " IPSTR, IP2STR(&ip_info->netmask));
+    ESP_LOGI("ETHERNET", "GW: " IPSTR, IP2STR(&ip_info->gw));
+#if CONFIG_TURBO_ETH_THROUGHPUT_STATS
+    s_eth_rx_stats.ip_addr = ip_info->ip.addr;
+#endif
+    network_on_got_ip(NETWORK_INTERFACE_ETH, ip_info->ip.addr);
+}
+
+int init_eth() {
+    esp_err_t err;
+    uint8_t eth_port_count;
+    esp_eth_handle_t* eth_handles;
+    err = ethernet_init_all(&eth_handles, &eth_port_count);
+    if (err != ESP_OK) {
+        ESP_LOGI("ETH INIT", "Ethernet initi all failed");
+        return err;
+    }
+
+    if (eth_port_count == 0) {
+        ESP_LOGI("ETH INIT", "No Ethernet port found");
+        return ESP_FAIL;
+    }
+    if (eth_port_count > 1) {
+        ESP_LOGW("ETH INIT", "%u Ethernet ports found, only the first one is used", eth_port_count);
+    }
+
+    esp_netif_inherent_config_t base_cfg = ESP_NETIF_INHERENT_DEFAULT_ETH();
+    base_cfg.route_prio = NETWORK_ETH_ROUTE_PRIO;
+    esp_netif_config_t cfg = ESP_NETIF_DEFAULT_ETH();
+    cfg.base = &base_cfg;
+    esp_netif_t* netif = esp_netif_new(&cfg);
+    s_network_interfaces[NETWORK_INTERFACE_ETH].netif = netif;
+    err = esp_netif_attach(netif, esp_eth_new_netif_glue(eth_handles[0]));
+    if (err != ESP_OK) {
+        ESP_LOGI("ETH INIT", "Attach glue failed");
+        return err;
+    }
+#if CONFIG_TURBO_ETH_THROUGHPUT_STATS
+    err = eth_rx_stats_attach(eth_handles[0], netif);
+    if (err != ESP_OK) {
+        ESP_LOGI("ETH INIT", "Failed to wrap the Ethernet input path");
+        return err;
+    }
+#endif
+
+    err = esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, &eth_event_handler_pipi, NULL);
+    if (err != ESP_OK) {
+        ESP_LOGI("ETH INIT", "Failed to attach event handler.");
+        return err;
+    }
+
+    err = esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_LOST_IP, &eth_event_handler_pipi, NULL);
+    if (err != ESP_OK) {
+        ESP_LOGI("ETH INIT", "Failed to attach lost ip event handler.");
+        return err;
+    }
+
+    err = esp_event_handler_register(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &eth_event_handler_pipi, NULL);
+    if (err != ESP_OK) {
+        ESP_LOGI("ETH INIT", "Failed to attach link event handler.");
+        return err;
+    }
+
+    err = esp_eth_start(eth_handles[0]);
+    if (err != ESP_OK) {
+        ESP_LOGI("ETH INIT", "Failed to start eth handle");
+        return err;
+    }
+
+    return ESP_OK;
+}
+
+// Blocks until one of the interfaces has an IP address.
+static void network_wait_for_ip(void)
+{
+    xEventGroupWaitBits(s_network_event_group, BIT(NETWORK_INTERFACE_COUNT) - 1, pdFALSE, pdFALSE, portMAX_DELAY);
+}
+
+// Brings up Ethernet and Wi-Fi side by side without waiting for either of them. A
+// board without Ethernet runs on Wi-Fi alone.
+static esp_err_t network_manager_start(network_link_lost_cb_t link_lost_cb)
+{
+    s_network_event_group = xEventGroupCreate();
+    s_network_link_lost_cb = link_lost_cb;
+
+    if (init_eth() != ESP_OK) {
+        ESP_LOGW(TAG_NETWORK, "Ethernet unavailable, running on Wi-Fi only");
+    }
+    return wifi_init_sta();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_eth.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+
+// Ethernet receive counters, enabled by CONFIG_TURBO_ETH_THROUGHPUT_STATS. The Ethernet
+// input path is wrapped so that every packet handed by the MAC driver to lwIP is
+// counted and timestamped; tcp_server compares that timestamp with the moment recv()
+// returns to measure the stack latency.
+#if CONFIG_TURBO_ETH_THROUGHPUT_STATS
+typedef struct {
+    volatile uint32_t packets;
+    volatile uint32_t bytes;
+    // esp_timer timestamp of the last packet handed to lwIP
+    volatile int64_t last_rx_us;
+    // IPv4 address of the Ethernet interface (network byte order), 0 without lease
+    volatile uint32_t ip_addr;
+} eth_rx_stats_t;
+
+static eth_rx_stats_t s_eth_rx_stats = {0};
+
+// Runs in the Ethernet RX task, in place of the input function installed by the netif glue
+static esp_err_t eth_rx_stats_input(esp_eth_handle_t handle, uint8_t* buffer, uint32_t length, void* netif)
+{
+    s_eth_rx_stats.last_rx_us = esp_timer_get_time();
+    ++s_eth_rx_stats.packets;
+    s_eth_rx_stats.bytes += length;
+    return esp_netif_receive((esp_netif_t*) netif, buffer, length, NULL);
+}
+
+// Must be called after esp_netif_attach(), which installs the default input path.
+static esp_err_t eth_rx_stats_attach(esp_eth_handle_t handle, esp_netif_t* netif)
+{
+    return esp_eth_update_input_path(handle, eth_rx_stats_input, netif);
+}
+#endif
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+
+// Encodings of the pixels of a received frame. PIXEL_FORMAT_NATIVE is the historical
+// format: RGB triplets, or RGBW quadruplets with CONFIG_TURBO_INPUT_RGBW. The compact
+// formats trade color depth for bandwidth and are expanded to RGB while the frame is
+// written into the pixel buffer, each with a table lookup or fixed-point arithmetic
+// and no branch on the pixel value.
+typedef enum {
+    PIXEL_FORMAT_NATIVE,   // RGB(W), one byte per channel
+    PIXEL_FORMAT_RGB565,   // 16-bit little endian, 5 bits red, 6 bits green, 5 bits blue
+    PIXEL_FORMAT_PALETTE8, // Index in the 256-entry RGB palette uploaded by the client
+    PIXEL_FORMAT_HSV,      // Hue, saturation, value, one byte each
+    PIXEL_FORMAT_COUNT,
+} pixel_format_t;
+
+// Bytes per pixel of each format
+static const uint8_t PIXEL_FORMAT_BYTES[PIXEL_FORMAT_COUNT] = {
+#if CONFIG_TURBO_INPUT_RGBW
+    [PIXEL_FORMAT_NATIVE] = 4,
+#else
+    [PIXEL_FORMAT_NATIVE] = 3,
+#endif
+    [PIXEL_FORMAT_RGB565] = 2,
+    [PIXEL_FORMAT_PALETTE8] = 1,
+    [PIXEL_FORMAT_HSV] = 3,
+};
+
+static const char* const PIXEL_FORMAT_NAMES[PIXEL_FORMAT_COUNT] = {
+    [PIXEL_FORMAT_NATIVE] = "native",
+    [PIXEL_FORMAT_RGB565] = "rgb565",
+    [PIXEL_FORMAT_PALETTE8] = "palette8",
+    [PIXEL_FORMAT_HSV] = "hsv",
+};
+
+#define PIXEL_PALETTE_ENTRIES 256
+// A palette upload is PIXEL_PALETTE_ENTRIES RGB triplets
+#define PIXEL_PALETTE_SIZE (PIXEL_PALETTE_ENTRIES * 3)
+
+typedef uint8_t pixel_palette_t[PIXEL_PALETTE_ENTRIES][3];
+
+// Fully saturated color of each hue at full value, filled by pixel_format_init()
+static pixel_palette_t s_hue_table;
+
+// Hue 0 is red, 85 green and 170 blue. The six sectors of the color wheel are linear
+// ramps, computed once here so that the per-pixel conversion is a lookup.
+static void pixel_format_init(void)
+{
+    for (uint32_t hue = 0; hue < PIXEL_PALETTE_ENTRIES; ++hue) {
+        const uint32_t position = hue * 6;
+        const uint32_t sector = position >> 8;
+        const uint8_t rising = position & 0xFF;
+        const uint8_t falling = 255 - rising;
+        static const uint8_t SECTOR_CHANNELS[6][3] = {
+            // Index 0: 255, 1: rising, 2: falling, 3: 0
+            {0, 1, 3}, {2, 0, 3}, {3, 0, 1}, {3, 2, 0}, {1, 3, 0}, {0, 3, 2},
+        };
+        const uint8_t levels[4] = {255, rising, falling, 0};
+        for (int c = 0; c < 3; ++c) {
+            s_hue_table[hue][c] = levels[SECTOR_CHANNELS[sector][c]];
+        }
+    }
+}
+
+// value * (scale + 1) / 256: exact for scale 0 and 255
+static inline uint8_t pixel_scale8(uint8_t value, uint8_t scale)
+{
+    return ((uint32_t) value * (scale + 1)) >> 8;
+}
+
+// Expanders of the compact formats: pixel index of the frame to RGB. show_frame() has
+// one loop per format, so that the format is not tested for each pixel; PIXEL_FORMAT_NATIVE
+// frames are not expanded.
+static inline void pixel_expand_rgb565(const uint8_t* frame, uint32_t index, uint8_t rgb[3])
+{
+    const uint32_t packed = frame[2 * index] | frame[2 * index + 1] << 8;
+    const uint32_t red = packed >> 11;
+    const uint32_t green = (packed >> 5) & 0x3F;
+    const uint32_t blue = packed & 0x1F;
+    // Replicating the high bits maps the maximum to 255
+    rgb[0] = red << 3 | red >> 2;
+    rgb[1] = green << 2 | green >> 4;
+    rgb[2] = blue << 3 | blue >> 2;
+}
+
+static inline void pixel_expand_palette8(const uint8_t* frame, uint32_t index, const pixel_palette_t palette,
+                                         uint8_t rgb[3])
+{
+    const uint8_t* color = palette[frame[index]];
+    rgb[0] = color[0];
+    rgb[1] = color[1];
+    rgb[2] = color[2];
+}
+
+static inline void pixel_expand_hsv(const uint8_t* frame, uint32_t index, uint8_t rgb[3])
+{
+    const uint8_t* hsv = frame + 3 * index;
+    const uint8_t* hue = s_hue_table[hsv[0]];
+    // Desaturating raises every channel towards full, then value scales the result
+    for (int c = 0; c < 3; ++c) {
+        rgb[c] = pixel_scale8(255 - pixel_scale8(255 - hue[c], hsv[1]), hsv[2]);
+    }
+}
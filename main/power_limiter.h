@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Current model of the strip: each color channel draws ma_per_channel at full
+// brightness, linearly, on top of a constant idle current per LED.
+typedef struct {
+    uint32_t budget_ma; // 0 disables the limiter
+    uint32_t ma_per_channel;
+    uint32_t idle_ma_per_led;
+} power_limiter_config_t;
+
+// channel_sum is the sum of every channel byte of the frame.
+static uint32_t power_estimate_ma(const power_limiter_config_t* config, uint32_t channel_sum, uint32_t led_count)
+{
+    return led_count * config->idle_ma_per_led + (uint64_t) channel_sum * config->ma_per_channel / 255;
+}
+
+// The idle current alone is over the budget: the limiter can only blank the strip
+static bool power_limiter_budget_below_idle(const power_limiter_config_t* config, uint32_t led_count)
+{
+    return config->budget_ma != 0 && led_count * config->idle_ma_per_led >= config->budget_ma;
+}
+
+// Scales the pixels down so the estimated current fits the budget. Only walks the
+// buffer when the limiter engages, the sum comes from the conversion loop. Returns
+// true when the frame was scaled.
+static bool power_limit(const power_limiter_config_t* config, uint8_t* pixels, size_t size, uint32_t estimate_ma,
+                        uint32_t led_count)
+{
+    if (config->budget_ma == 0 || estimate_ma <= config->budget_ma) {
+        return false;
+    }
+    const uint32_t idle_ma = led_count * config->idle_ma_per_led;
+    const uint32_t active_ma = estimate_ma - idle_ma;
+    const uint32_t available_ma = config->budget_ma > idle_ma ? config->budget_ma - idle_ma : 0;
+    // 8.8 fixed point, rounded down so the result stays under the budget. Without
+    // active current the idle current is over the budget: the frame is blanked.
+    const uint32_t scale = active_ma ? (uint64_t) available_ma * 256 / active_ma : 0;
+    for (size_t i = 0; i < size; ++i) {
+        pixels[i] = pixels[i] * scale >> 8;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+// RGB to RGBW conversion for strips with a white LED (SK6812 GRBW). The white point is
+// the color of the white LED expressed in RGB units: as much of it as fits in the
+// requested color is moved to the white channel and removed from R, G and B.
+// RGBW_WHITE_POINT_NEUTRAL is plain min(R, G, B) extraction; a calibrated white point
+// keeps the hue of colors near white on strips whose white LED is warm or cool.
+static const uint8_t RGBW_WHITE_POINT_NEUTRAL[3] = {255, 255, 255};
+// Typical SK6812 warm white (about 3000 K), replace with values matched on the actual strip
+static const uint8_t RGBW_WHITE_POINT_WARM[3] = {255, 176, 96};
+
+typedef struct {
+    uint8_t white_point[3];
+    // 255 / white_point[c], 16.16 fixed point
+    uint32_t inverse[3];
+} rgbw_converter_t;
+
+static void rgbw_converter_init(rgbw_converter_t* converter, const uint8_t white_point[3])
+{
+    for (int c = 0; c < 3; ++c) {
+        const uint32_t w = white_point[c] ? white_point[c] : 1;
+        converter->white_point[c] = w;
+        converter->inverse[c] = (255u << 16) / w;
+    }
+}
+
+// Writes the GRBW bytes of an RGB color.
+static inline void rgbw_convert(const rgbw_converter_t* converter, const uint8_t rgb[3], uint8_t grbw[4])
+{
+    uint32_t white = 255;
+    for (int c = 0; c < 3; ++c) {
+        const uint32_t candidate = (rgb[c] * converter->inverse[c]) >> 16;
+        if (candidate < white) {
+            white = candidate;
+        }
+    }
+
+    uint8_t out[3];
+    for (int c = 0; c < 3; ++c) {
+        const uint32_t removed = white * converter->white_point[c] / 255;
+        out[c] = rgb[c] > removed ? rgb[c] - removed : 0;
+    }
+    grbw[0] = out[1];
+    grbw[1] = out[0];
+    grbw[2] = out[2];
+    grbw[3] = white;
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+// Scheduling layout of the application.
+//
+// Core 0 carries the whole network stack: the Wi-Fi driver task and lwIP tcpip task
+// (pinned through sdkconfig.defaults), the Ethernet RX task, and the TCP/UDP receivers.
+// Core 1 is reserved for the LED pipeline: ledstrip_task creates the RMT channel, so
+// the RMT encoder ISR is allocated on core 1 as well and never competes with Wi-Fi.
+typedef struct {
+    const char* name;
+    uint32_t stack_size;
+    UBaseType_t priority;
+    BaseType_t core;
+#if CONFIG_TURBO_STATIC_PIPELINE
+    StackType_t* stack; // stack_size bytes
+    StaticTask_t* tcb;
+#endif
+} task_layout_t;
+
+// Stack sizes, in bytes. The receivers read straight into the frame buffers and the
+// consumer only holds a message on its stack, so none of them needs large locals.
+// Check the high-water marks reported by cpu_report() when changing these.
+#define TCP_SERVER_STACK_SIZE 4096
+#define AUDIO_SERVER_STACK_SIZE 3072
+// Holds the 1 KB WebSocket handshake request on its stack
+#define WEBSOCKET_SERVER_STACK_SIZE 4096
+#define LEDSTRIP_STACK_SIZE 4096
+#define CPU_REPORT_STACK_SIZE 4096
+#define TRACE_SERVER_STACK_SIZE 3072
+#define CAPTURE_SERVER_STACK_SIZE 3072
+
+#if CONFIG_TURBO_STATIC_PIPELINE
+#define TASK_LAYOUT_STATIC_STORAGE(prefix, size) \
+    static StackType_t prefix##_stack[size];    \
+    static StaticTask_t prefix##_tcb;
+#define TASK_LAYOUT_STATIC_FIELDS(prefix) .stack = prefix##_stack, .tcb = &prefix##_tcb,
+TASK_LAYOUT_STATIC_STORAGE(s_tcp_server, TCP_SERVER_STACK_SIZE)
+#if !CONFIG_TURBO_FRAME_AUTH
+TASK_LAYOUT_STATIC_STORAGE(s_audio_server, AUDIO_SERVER_STACK_SIZE)
+TASK_LAYOUT_STATIC_STORAGE(s_websocket_server, WEBSOCKET_SERVER_STACK_SIZE)
+#endif
+TASK_LAYOUT_STATIC_STORAGE(s_ledstrip, LEDSTRIP_STACK_SIZE)
+TASK_LAYOUT_STATIC_STORAGE(s_cpu_report, CPU_REPORT_STACK_SIZE)
+#if CONFIG_TURBO_TRACE
+TASK_LAYOUT_STATIC_STORAGE(s_trace_server, TRACE_SERVER_STACK_SIZE)
+#endif
+#if CONFIG_TURBO_CAPTURE
+TASK_LAYOUT_STATIC_STORAGE(s_capture_server, CAPTURE_SERVER_STACK_SIZE)
+#endif
+#else
+#define TASK_LAYOUT_STATIC_FIELDS(prefix)
+#endif
+
+enum {
+    NETWORK_CPU = 0,
+    LED_CPU = 1,
+};
+
+static const task_layout_t TCP_SERVER_TASK_LAYOUT = {
+    .name = "tcp_server", .stack_size = TCP_SERVER_STACK_SIZE, .priority = 5, .core = NETWORK_CPU,
+    TASK_LAYOUT_STATIC_FIELDS(s_tcp_server)
+};
+// Not started with CONFIG_TURBO_FRAME_AUTH, they take unauthenticated data
+#if !CONFIG_TURBO_FRAME_AUTH
+static const task_layout_t AUDIO_SERVER_TASK_LAYOUT = {
+    .name = "audio_server", .stack_size = AUDIO_SERVER_STACK_SIZE, .priority = 6, .core = NETWORK_CPU,
+    TASK_LAYOUT_STATIC_FIELDS(s_audio_server)
+};
+static const task_layout_t WEBSOCKET_SERVER_TASK_LAYOUT = {
+    .name = "websocket_server", .stack_size = WEBSOCKET_SERVER_STACK_SIZE, .priority = 5, .core = NETWORK_CPU,
+    TASK_LAYOUT_STATIC_FIELDS(s_websocket_server)
+};
+#endif
+// Above every network-side task so a refresh is never preempted by a receiver
+static const task_layout_t LEDSTRIP_TASK_LAYOUT = {
+    .name = "ledstrip", .stack_size = LEDSTRIP_STACK_SIZE, .priority = 10, .core = LED_CPU,
+    TASK_LAYOUT_STATIC_FIELDS(s_ledstrip)
+};
+static const task_layout_t CPU_REPORT_TASK_LAYOUT = {
+    .name = "cpu_report", .stack_size = CPU_REPORT_STACK_SIZE, .priority = 1, .core = NETWORK_CPU,
+    TASK_LAYOUT_STATIC_FIELDS(s_cpu_report)
+};
+#if CONFIG_TURBO_TRACE
+// Only runs while a trace is downloaded
+static const task_layout_t TRACE_SERVER_TASK_LAYOUT = {
+    .name = "trace_server", .stack_size = TRACE_SERVER_STACK_SIZE, .priority = 1, .core = NETWORK_CPU,
+    TASK_LAYOUT_STATIC_FIELDS(s_trace_server)
+};
+#endif
+#if CONFIG_TURBO_CAPTURE
+// Only runs while a capture is downloaded
+static const task_layout_t CAPTURE_SERVER_TASK_LAYOUT = {
+    .name = "capture_server", .stack_size = CAPTURE_SERVER_STACK_SIZE, .priority = 1, .core = NETWORK_CPU,
+    TASK_LAYOUT_STATIC_FIELDS(s_capture_server)
+};
+#endif
+// Interval between two CPU load reports, 0 disables the report task
+static const uint32_t CPU_REPORT_PERIOD_MS = 10 * 1000;
+
+static BaseType_t task_layout_create(const task_layout_t* layout, TaskFunction_t task, void* parameters)
+{
+#if CONFIG_TURBO_STATIC_PIPELINE
+    TaskHandle_t handle = xTaskCreateStaticPinnedToCore(task, layout->name, layout->stack_size, parameters,
+                                                        layout->priority, layout->stack, layout->tcb, layout->core);
+    return handle != NULL ? pdPASS : pdFAIL;
+#else
+    return xTaskCreatePinnedToCore(task, layout->name, layout->stack_size, parameters,
+                                   layout->priority, NULL, layout->core);
+#endif
+}
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS && CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+static const char *TAG_CPU = "cpu_report";
+#define CPU_REPORT_MAX_TASKS 32
+
+typedef struct {
+    TaskHandle_t handle;
+    configRUN_TIME_COUNTER_TYPE run_time;
+} cpu_report_sample_t;
+
+static cpu_report_sample_t s_cpu_report_previous[CPU_REPORT_MAX_TASKS];
+static UBaseType_t s_cpu_report_previous_count = 0;
+
+static configRUN_TIME_COUNTER_TYPE previous_run_time(TaskHandle_t handle)
+{
+    for (UBaseType_t i = 0; i < s_cpu_report_previous_count; ++i) {
+        if (s_cpu_report_previous[i].handle == handle) {
+            return s_cpu_report_previous[i].run_time;
+        }
+    }
+    return 0;
+}
+
+// Logs the share of CPU time each task used since the previous report, along with its
+// core affinity, priority and stack high-water mark.
+static void cpu_report(void)
+{
+    static configRUN_TIME_COUNTER_TYPE previous_total = 0;
+    TaskStatus_t tasks[CPU_REPORT_MAX_TASKS];
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    const UBaseType_t count = uxTaskGetSystemState(tasks, CPU_REPORT_MAX_TASKS, &total);
+    if (count == 0) {
+        ESP_LOGW(TAG_CPU, "More than %d tasks, report skipped", CPU_REPORT_MAX_TASKS);
+        return;
+    }
+
+    // Percentages are relative to one core
+    const configRUN_TIME_COUNTER_TYPE elapsed = total - previous_total;
+    previous_total = total;
+    ESP_LOGI(TAG_CPU, "%-16s %4s %4s %6s %8s", "task", "core", "prio", "load", "stack_hw");
+    for (UBaseType_t i = 0; i < count; ++i) {
+        const configRUN_TIME_COUNTER_TYPE used = tasks[i].ulRunTimeCounter - previous_run_time(tasks[i].xHandle);
+        const uint32_t load_tenths = elapsed ? (uint64_t) used * 1000 / elapsed : 0;
+        const int core = tasks[i].xCoreID == tskNO_AFFINITY ? -1 : (int) tasks[i].xCoreID;
+        ESP_LOGI(TAG_CPU, "%-16s %4d %4u %4" PRIu32 ".%" PRIu32 "%% %8" PRIu32,
+                 tasks[i].pcTaskName, core, (unsigned) tasks[i].uxCurrentPriority,
+                 load_tenths / 10, load_tenths % 10, (uint32_t) tasks[i].usStackHighWaterMark);
+    }
+
+    for (UBaseType_t i = 0; i < count; ++i) {
+        s_cpu_report_previous[i].handle = tasks[i].xHandle;
+        s_cpu_report_previous[i].run_time = tasks[i].ulRunTimeCounter;
+    }
+    s_cpu_report_previous_count = count;
+
+    ESP_LOGI(TAG_CPU, "internal heap: %u bytes free, %u bytes minimum free, %u bytes largest block",
+             (unsigned) heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+             (unsigned) heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+             (unsigned) heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+}
+
+static void cpu_report_task(void* pvParameters)
+{
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(CPU_REPORT_PERIOD_MS));
+        cpu_report();
+    }
+}
+
+static void cpu_report_start(void)
+{
+    if (CPU_REPORT_PERIOD_MS != 0) {
+        task_layout_create(&CPU_REPORT_TASK_LAYOUT, cpu_report_task, NULL);
+    }
+}
+#else
+static void cpu_report_start(void)
+{
+    ESP_LOGW("cpu_report", "FreeRTOS run-time stats disabled, no CPU load report");
+}
+#endif
@@ -1,39 +1,357 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "lwip/err.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
 #include "lwip/sockets.h"
+#include "ledstrip_pipeline.h"
+#include "network_stats.h"
+#include "trace.h"
+#include "capture.h"
+#include "frame_auth.h"
 
 static const char *TAG_SERVER = "tcp_server";
-static void process_data(const int sock, QueueHandle_t* queue_handle)
+// Interval between two receive statistics reports, in microseconds
+static const int64_t TCP_SERVER_STATS_PERIOD_US = 5 * 1000 * 1000;
+#if CONFIG_TURBO_FRAME_CRC
+// Each frame is followed by the CRC-32 of its bytes (IEEE 802.3, as zlib.crc32),
+// little endian. Corrupt frames are dropped.
+#define TCP_FRAME_CRC_SIZE 4
+// Consecutive corrupt frames after which the stream is assumed misaligned: the
+// connection is closed so that the sender starts over on a frame boundary.
+static const uint32_t TCP_SERVER_MAX_CRC_ERRORS = 3;
+#else
+#define TCP_FRAME_CRC_SIZE 0
+#endif
+#if CONFIG_TURBO_FRAME_AUTH
+// The AES-GCM tag takes the place of the CRC, see frame_auth.h
+#define TCP_FRAME_TRAILER_SIZE FRAME_AUTH_TAG_SIZE
+static frame_auth_t s_frame_auth;
+#else
+#define TCP_FRAME_TRAILER_SIZE TCP_FRAME_CRC_SIZE
+#endif
+// With CONFIG_TURBO_TCP_RECORDS, a client opens the connection with these bytes
+// followed by a pixel_format_t byte. The stream is then made of records, each starting
+// with a tcp_record_t byte: a frame in the negotiated format, or a palette of
+// PIXEL_PALETTE_SIZE bytes. Otherwise the stream is made of PIXEL_FORMAT_NATIVE frames
+// and has no header. The CRC or AES-GCM trailer, when enabled, follows the payload of
+// every record.
+#if CONFIG_TURBO_TCP_RECORDS
+static const uint8_t TCP_FORMAT_MAGIC[4] = {'T', 'L', 'F', 'M'};
+#define TCP_FORMAT_HEADER_SIZE (sizeof(TCP_FORMAT_MAGIC) + 1)
+#endif
+
+typedef enum {
+    TCP_RECORD_NONE = 0,
+    TCP_RECORD_FRAME = 'F',
+    TCP_RECORD_PALETTE = 'P',
+} tcp_record_t;
+
+typedef struct {
+    int64_t start_us;
+    uint32_t recv_calls;
+    uint32_t recv_bytes;
+    uint32_t frames;
+    uint32_t palettes;
+#if CONFIG_TURBO_FRAME_CRC
+    uint32_t frames_corrupt;
+    int64_t crc_time_us;
+#endif
+#if CONFIG_TURBO_FRAME_AUTH
+    uint32_t records_rejected;
+    int64_t auth_time_us;
+#endif
+#if CONFIG_TURBO_ETH_THROUGHPUT_STATS
+    // Time from the Ethernet driver handing the last packet to lwIP to recv() returning
+    int64_t eth_latency_sum_us;
+    int64_t eth_latency_max_us;
+    uint32_t eth_latency_count;
+    uint32_t eth_packets;
+    uint32_t eth_bytes;
+#endif
+} tcp_server_stats_t;
+
+static void reset_recv_stats(tcp_server_stats_t* stats)
+{
+    *stats = (tcp_server_stats_t) {.start_us = esp_timer_get_time()};
+#if CONFIG_TURBO_ETH_THROUGHPUT_STATS
+    stats->eth_packets = s_eth_rx_stats.packets;
+    stats->eth_bytes = s_eth_rx_stats.bytes;
+#endif
+}
+
+#if CONFIG_TURBO_ETH_THROUGHPUT_STATS
+static void record_eth_latency(tcp_server_stats_t* stats, uint32_t local_ip)
+{
+    // Only meaningful for a connection that came through the Ethernet interface
+    if (local_ip == 0 || local_ip != s_eth_rx_stats.ip_addr) {
+        return;
+    }
+    const int64_t latency_us = esp_timer_get_time() - s_eth_rx_stats.last_rx_us;
+    stats->eth_latency_sum_us += latency_us;
+    if (latency_us > stats->eth_latency_max_us) {
+        stats->eth_latency_max_us = latency_us;
+    }
+    ++stats->eth_latency_count;
+}
+#endif
+
+static void report_recv_stats(tcp_server_stats_t* stats, bool force)
+{
+    const int64_t now_us = esp_timer_get_time();
+    const int64_t elapsed_us = now_us - stats->start_us;
+    if (!force && elapsed_us < TCP_SERVER_STATS_PERIOD_US) {
+        return;
+    }
+    if (stats->recv_calls == 0 || elapsed_us <= 0) {
+        reset_recv_stats(stats);
+        return;
+    }
+    // Bits per microsecond is Mbit/s, reported with two decimals
+    const uint32_t mbps_hundredths = (uint64_t) stats->recv_bytes * 8 * 100 / elapsed_us;
+    ESP_LOGI(TAG_SERVER, "%" PRIu32 " recv() calls, %" PRIu32 " bytes per call, %" PRIu32 " frames, %" PRIu32 " palettes, %" PRIu32 ".%02" PRIu32 " Mbit/s",
+             stats->recv_calls, stats->recv_bytes / stats->recv_calls, stats->frames, stats->palettes,
+             mbps_hundredths / 100, mbps_hundredths % 100);
+#if CONFIG_TURBO_FRAME_CRC
+    const uint32_t checked = stats->frames + stats->frames_corrupt;
+    ESP_LOGI(TAG_SERVER, "crc: %" PRIu32 " corrupt frames, %" PRIi64 " us per frame, %" PRIi64 " us total",
+             stats->frames_corrupt, checked ? stats->crc_time_us / checked : 0, stats->crc_time_us);
+#endif
+#if CONFIG_TURBO_FRAME_AUTH
+    const uint32_t opened = stats->frames + stats->palettes + stats->records_rejected;
+    ESP_LOGI(TAG_SERVER, "auth: %" PRIu32 " rejected records, %" PRIi64 " us per record, %" PRIi64 " us total",
+             stats->records_rejected, opened ? stats->auth_time_us / opened : 0, stats->auth_time_us);
+#endif
+#if CONFIG_TURBO_ETH_THROUGHPUT_STATS
+    const uint32_t eth_packets = s_eth_rx_stats.packets - stats->eth_packets;
+    const uint32_t eth_bytes = s_eth_rx_stats.bytes - stats->eth_bytes;
+    const uint32_t eth_mbps_hundredths = (uint64_t) eth_bytes * 8 * 100 / elapsed_us;
+    ESP_LOGI(TAG_SERVER, "ethernet: %" PRIu32 " packets, %" PRIu32 ".%02" PRIu32 " Mbit/s, driver to recv() %" PRIi64 " us avg, %" PRIi64 " us max",
+             eth_packets, eth_mbps_hundredths / 100, eth_mbps_hundredths % 100,
+             stats->eth_latency_count ? stats->eth_latency_sum_us / stats->eth_latency_count : 0,
+             stats->eth_latency_max_us);
+#endif
+    reset_recv_stats(stats);
+}
+
+// Connection being served, shared with the network manager event handler. The lock
+// covers both fields and the close() of the socket: without it, a late link-down event
+// could shut down the next client, accepted on the same descriptor number.
+static SemaphoreHandle_t s_tcp_client_lock;
+static StaticSemaphore_t s_tcp_client_lock_storage;
+static int s_tcp_client_sock = -1;
+static uint32_t s_tcp_client_local_ip = 0;
+
+// Called by the network manager when an interface loses its link. A connection that
+// came through it would otherwise sit in recv() until the keepalive expires, so it is
+// shut down right away and the server goes back to accept(), reachable through the
+// surviving interface.
+static void tcp_server_drop_clients(uint32_t ip_addr)
+{
+    // No client before the server task has started
+    if (s_tcp_client_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(s_tcp_client_lock, portMAX_DELAY);
+    if (s_tcp_client_sock >= 0 && s_tcp_client_local_ip == ip_addr) {
+        ESP_LOGW(TAG_SERVER, "Interface of the current connection went down, dropping it");
+        shutdown(s_tcp_client_sock, SHUT_RDWR);
+    }
+    xSemaphoreGive(s_tcp_client_lock);
+}
+
+#if CONFIG_TURBO_TCP_RECORDS
+// Reads the format header that opens every connection. Returns false when the
+// connection must be closed.
+static bool negotiate_format(const int sock, pixel_format_t* format)
+{
+    uint8_t header[TCP_FORMAT_HEADER_SIZE];
+    size_t received = 0;
+    while (received < sizeof(header)) {
+        const int len = recv(sock, header + received, sizeof(header) - received, 0);
+        if (len <= 0) {
+            ESP_LOGW(TAG_SERVER, "Connection closed before the format header");
+            return false;
+        }
+        CAPTURE_RECV(header + received, len);
+        received += len;
+    }
+    if (memcmp(header, TCP_FORMAT_MAGIC, sizeof(TCP_FORMAT_MAGIC)) != 0) {
+        ESP_LOGE(TAG_SERVER, "No format header, closing the connection");
+        return false;
+    }
+    if (header[sizeof(TCP_FORMAT_MAGIC)] >= PIXEL_FORMAT_COUNT) {
+        ESP_LOGE(TAG_SERVER, "Unknown pixel format %d", header[sizeof(TCP_FORMAT_MAGIC)]);
+        return false;
+    }
+    *format = header[sizeof(TCP_FORMAT_MAGIC)];
+    ESP_LOGI(TAG_SERVER, "Client negotiated %s pixels", PIXEL_FORMAT_NAMES[*format]);
+    return true;
+}
+#endif
+
+// Receives straight into the frame buffers of the pipeline. Each recv() asks for at
+// most the bytes missing to complete the current payload, so a payload never straddles
+// two reads and no intermediate copy is needed. With CONFIG_TURBO_FRAME_CRC the CRC is
+// updated on each chunk as it lands in the buffer and checked against the trailer.
+// With CONFIG_TURBO_FRAME_AUTH the payload is decrypted in place once its tag is in.
+static void process_data(const int sock, ledstrip_pipeline_t* pipeline)
 {
-    char rx_buffer[3000];
-    uint8_t tx_buffer[3];
-    uint8_t tx_index = 0;
+#if CONFIG_TURBO_FRAME_AUTH
+    uint8_t session_id[FRAME_AUTH_SESSION_ID_SIZE];
+    frame_auth_start_session(&s_frame_auth, session_id);
+    if (send(sock, session_id, sizeof(session_id), 0) != sizeof(session_id)) {
+        ESP_LOGE(TAG_SERVER, "Unable to send the session id: errno %d", errno);
+        return;
+    }
+#endif
+#if CONFIG_TURBO_TCP_RECORDS
+    const bool records = true;
+    pixel_format_t format;
+    if (!negotiate_format(sock, &format)) {
+        return;
+    }
+#else
+    const bool records = false;
+    const pixel_format_t format = PIXEL_FORMAT_NATIVE;
+#endif
+    // Native pixels are the largest, every payload fits in a buffer of the pool
+    const size_t pixel_count = pipeline->frame_size / PIXEL_FORMAT_BYTES[PIXEL_FORMAT_NATIVE];
+    const size_t frame_size = pixel_count * PIXEL_FORMAT_BYTES[format];
+    tcp_server_stats_t stats;
+    reset_recv_stats(&stats);
+    uint8_t* frame = ledstrip_pipeline_acquire_frame(pipeline);
+    size_t frame_index = 0;
+    uint8_t trailer[TCP_FRAME_TRAILER_SIZE > 4 ? TCP_FRAME_TRAILER_SIZE : 4];
+    uint8_t record = records ? TCP_RECORD_NONE : TCP_RECORD_FRAME;
+    size_t payload_size = frame_size;
+#if CONFIG_TURBO_FRAME_CRC
+    uint32_t crc = 0;
+    uint32_t crc_errors = 0;
+#endif
     while (true) {
-        int len = recv(sock, rx_buffer, sizeof(rx_buffer) - 1, 0);
+        if (record == TCP_RECORD_NONE) {
+            const int len = recv(sock, &record, 1, 0);
+            if (len <= 0) {
+                ESP_LOGW(TAG_SERVER, "Connection closed");
+                break;
+            }
+            CAPTURE_RECV(&record, 1);
+            ++stats.recv_calls;
+            ++stats.recv_bytes;
+            if (record == TCP_RECORD_FRAME) {
+                payload_size = frame_size;
+            } else if (record == TCP_RECORD_PALETTE && PIXEL_PALETTE_SIZE <= pipeline->frame_size) {
+                payload_size = PIXEL_PALETTE_SIZE;
+            } else {
+                ESP_LOGE(TAG_SERVER, "Unsupported record 0x%02x", record);
+                break;
+            }
+            continue;
+        }
+
+        const bool in_frame = frame_index < payload_size;
+        uint8_t* destination = in_frame ? frame + frame_index : trailer + (frame_index - payload_size);
+        const size_t wanted = in_frame ? payload_size - frame_index : payload_size + TCP_FRAME_TRAILER_SIZE - frame_index;
+        TRACE_BEGIN(TRACE_RECV);
+        int len = recv(sock, destination, wanted, 0);
+        TRACE_END(TRACE_RECV, len > 0 ? len : 0);
         if (len < 0) {
             ESP_LOGE(TAG_SERVER, "Error occurred during receiving: errno %d", errno);
-            return;
+            break;
         } else if (len == 0) {
             ESP_LOGW(TAG_SERVER, "Connection closed");
-            return;
-        } else {
-            for (int i = 0; i < len; ++i) {
-                tx_buffer[tx_index] = rx_buffer[i];
-                ++tx_index;
-                if (tx_index == 3) {
-                    while (!xQueueSend(*queue_handle, (void*)&tx_buffer, 5));
-                    tx_index = 0;
-                }
+            break;
+        }
+
+        CAPTURE_RECV(destination, len);
+        ++stats.recv_calls;
+        stats.recv_bytes += len;
+#if CONFIG_TURBO_ETH_THROUGHPUT_STATS
+        record_eth_latency(&stats, s_tcp_client_local_ip);
+#endif
+#if CONFIG_TURBO_FRAME_CRC
+        if (in_frame) {
+            const int64_t crc_start_us = esp_timer_get_time();
+            crc = esp_rom_crc32_le(crc, destination, len);
+            stats.crc_time_us += esp_timer_get_time() - crc_start_us;
+        }
+#endif
+        frame_index += len;
+        if (frame_index < payload_size + TCP_FRAME_TRAILER_SIZE) {
+            continue;
+        }
+        frame_index = 0;
+        const tcp_record_t completed = record;
+        if (records) {
+            record = TCP_RECORD_NONE;
+        }
+
+#if CONFIG_TURBO_FRAME_CRC
+        const uint32_t expected = trailer[0] | trailer[1] << 8 | trailer[2] << 16 | (uint32_t) trailer[3] << 24;
+        const bool valid = crc == expected;
+        crc = 0;
+        if (!valid) {
+            ++stats.frames_corrupt;
+            if (++crc_errors >= TCP_SERVER_MAX_CRC_ERRORS) {
+                ESP_LOGW(TAG_SERVER, "%" PRIu32 " corrupt frames in a row, closing the connection", crc_errors);
+                break;
             }
+            // The buffer is reused for the next frame
+            continue;
+        }
+        crc_errors = 0;
+#endif
+#if CONFIG_TURBO_FRAME_AUTH
+        const uint8_t aad[FRAME_AUTH_AAD_SIZE] = {completed, format};
+        const int64_t auth_start_us = esp_timer_get_time();
+        const bool authentic = frame_auth_open(&s_frame_auth, frame, payload_size, aad, trailer);
+        stats.auth_time_us += esp_timer_get_time() - auth_start_us;
+        if (!authentic) {
+            // TCP already guards against corruption: the sender has the wrong key or the
+            // stream was tampered with
+            ++stats.records_rejected;
+            ESP_LOGW(TAG_SERVER, "Record failed authentication, closing the connection");
+            break;
+        }
+#endif
+        const ledstrip_message_t message = {
+            .type = completed == TCP_RECORD_PALETTE ? LEDSTRIP_MESSAGE_PALETTE : LEDSTRIP_MESSAGE_FRAME,
+            .received_us = esp_timer_get_time(),
+            .frame = frame,
+            .format = format,
+        };
+        xQueueSend(pipeline->messages, &message, portMAX_DELAY);
+        TRACE_INSTANT(TRACE_FRAME_QUEUED, 0);
+        if (completed == TCP_RECORD_PALETTE) {
+            ++stats.palettes;
+        } else {
+            ++stats.frames;
         }
+        report_recv_stats(&stats, false);
+        frame = ledstrip_pipeline_acquire_frame(pipeline);
     }
+    report_recv_stats(&stats, true);
+    // A partial frame is never shown
+    ledstrip_pipeline_release_frame(pipeline, frame);
 }
 
 
 static void tcp_server_task(void *pvParameters)
 {
     static const uint32_t port = 1234;
-    QueueHandle_t* queue_handle = (QueueHandle_t*) pvParameters;
+    ledstrip_pipeline_t* pipeline = (ledstrip_pipeline_t*) pvParameters;
+    s_tcp_client_lock = xSemaphoreCreateMutexStatic(&s_tcp_client_lock_storage);
+#if CONFIG_TURBO_FRAME_AUTH
+    const esp_err_t auth_err = frame_auth_init(&s_frame_auth);
+    if (auth_err != ESP_OK) {
+        // Never falls back to accepting frames from anyone
+        ESP_LOGE(TAG_SERVER, "Invalid CONFIG_TURBO_FRAME_AUTH_KEY (%s), not serving frames", esp_err_to_name(auth_err));
+        vTaskDelete(NULL);
+        return;
+    }
+#endif
     char addr_str[128];
     int addr_family = AF_INET;
     int ip_protocol = 0;
@@ -41,6 +359,7 @@ static void tcp_server_task(void *pvParameters)
     int keepIdle = 1000;
     int keepInterval = 1000;
     int keepCount = 3;
+    int noDelay = 1;
     struct sockaddr_storage dest_addr;
 
     if (addr_family == AF_INET) {
@@ -94,6 +413,9 @@ static void tcp_server_task(void *pvParameters)
         setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &keepIdle, sizeof(int));
         setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &keepInterval, sizeof(int));
         setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &keepCount, sizeof(int));
+        // Streaming profile. lwIP ignores SO_RCVBUF and SO_RCVLOWAT on TCP sockets: the
+        // receive buffer is the TCP window, sized from the frame size in sdkconfig.defaults.
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(int));
         // Convert ip address to string
         if (source_addr.ss_family == PF_INET) {
             inet_ntoa_r(((struct sockaddr_in *)&source_addr)->sin_addr, addr_str, sizeof(addr_str) - 1);
@@ -101,10 +423,22 @@ static void tcp_server_task(void *pvParameters)
 
         ESP_LOGI(TAG_SERVER, "Socket accepted ip address: %s", addr_str);
 
-        process_data(sock, queue_handle);
+        struct sockaddr_in local_addr;
+        socklen_t local_addr_len = sizeof(local_addr);
+        const bool has_local_addr = getsockname(sock, (struct sockaddr *)&local_addr, &local_addr_len) == 0;
+        xSemaphoreTake(s_tcp_client_lock, portMAX_DELAY);
+        s_tcp_client_local_ip = has_local_addr ? local_addr.sin_addr.s_addr : 0;
+        s_tcp_client_sock = sock;
+        xSemaphoreGive(s_tcp_client_lock);
+
+        CAPTURE_BEGIN();
+        process_data(sock, pipeline);
 
+        xSemaphoreTake(s_tcp_client_lock, portMAX_DELAY);
+        s_tcp_client_sock = -1;
         shutdown(sock, 0);
         close(sock);
+        xSemaphoreGive(s_tcp_client_lock);
     }
 
 CLEAN_UP:
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_err.h"
+#include "esp_freertos_hooks.h"
+#include "esp_timer.h"
+
+// Event tracing, enabled by CONFIG_TURBO_TRACE. Each core appends begin/end and
+// instant events to its own ring buffer, timestamped with its cycle counter: an event
+// costs a read of the core ID and of the cycle counter, an atomic increment and an
+// 8-byte store, no lock and no formatting. The trace_record kernel of benchmark.h
+// prints the cycles per event on the board. The rings keep the last TRACE_RING_SIZE
+// events of each core; trace_server.h sends them on request and
+// tools/trace_to_chrome.py turns them into a Chrome trace / Perfetto JSON file.
+//
+// The cycle counters are 32 bits, per core, and wrap every 2^32 cycles, 17.9 s at
+// 240 MHz. A tick hook of each core records a TRACE_SYNC event every
+// TRACE_SYNC_PERIOD_TICKS with the time of esp_timer: two events of a ring are never
+// further apart than a wrap, and the syncs place both cores on a common time line.
+typedef enum {
+    TRACE_RECV,             // recv() of the TCP server, argument: bytes received
+    TRACE_FRAME_QUEUED,     // Frame handed to the LED task
+    TRACE_FRAME_DEQUEUED,   // Message taken by the LED task
+    TRACE_SHOW_FRAME,       // Frame written into the pixel buffer
+    TRACE_COMMIT_PIXELS,    // Pixel buffer handed to the driver with led_strip_set_pixel()
+    TRACE_REFRESH,          // led_strip_refresh(), rmt_transmit() and the wait for the end
+    TRACE_RMT_DONE,         // RMT transmission done, from the ISR
+    TRACE_SYNC,             // Bits 32..47 of esp_timer, followed by a TRACE_PHASE_SYNC_TIME event
+    TRACE_EVENT_COUNT,
+} trace_event_id_t;
+
+typedef enum {
+    TRACE_PHASE_BEGIN = 'B',
+    TRACE_PHASE_END = 'E',
+    TRACE_PHASE_INSTANT = 'i',
+    // Second half of a TRACE_SYNC: bits 0..31 of esp_timer in place of the cycles
+    TRACE_PHASE_SYNC_TIME = 'T',
+} trace_phase_t;
+
+#if CONFIG_TURBO_TRACE
+// Events kept per core, a power of two
+#define TRACE_RING_SIZE 512
+// One sync per second, well within a wrap of the cycle counter
+#define TRACE_SYNC_PERIOD_TICKS configTICK_RATE_HZ
+
+typedef struct {
+    uint32_t cycles; // Cycle counter of the core that recorded the event
+    uint8_t id;      // trace_event_id_t
+    uint8_t phase;   // trace_phase_t
+    uint16_t arg;
+} trace_event_t;
+
+typedef struct {
+    // Total number of events recorded, the ring holds the last TRACE_RING_SIZE of them
+    uint32_t head;
+    // Ticks until the next TRACE_SYNC, only touched by the tick hook of the core
+    uint32_t sync_countdown;
+    trace_event_t events[TRACE_RING_SIZE];
+} trace_ring_t;
+
+static trace_ring_t s_trace_rings[portNUM_PROCESSORS];
+// Cleared while the rings are read
+static volatile bool s_trace_enabled = true;
+
+// Also called from ISRs, hence IRAM. The slot is claimed with an atomic increment so
+// that an ISR preempting a task on the same core cannot take the same one.
+static inline IRAM_ATTR void trace_record(trace_event_id_t id, trace_phase_t phase, uint16_t arg)
+{
+    if (!s_trace_enabled) {
+        return;
+    }
+    trace_ring_t* ring = &s_trace_rings[esp_cpu_get_core_id()];
+    const uint32_t slot = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED) & (TRACE_RING_SIZE - 1);
+    ring->events[slot] = (trace_event_t) {
+        .cycles = esp_cpu_get_cycle_count(),
+        .id = id,
+        .phase = phase,
+        .arg = arg,
+    };
+}
+
+// Tick hook, in the tick ISR of each core
+static IRAM_ATTR void trace_sync_tick(void)
+{
+    trace_ring_t* ring = &s_trace_rings[esp_cpu_get_core_id()];
+    if (ring->sync_countdown > 0) {
+        --ring->sync_countdown;
+        return;
+    }
+    ring->sync_countdown = TRACE_SYNC_PERIOD_TICKS - 1;
+    if (!s_trace_enabled) {
+        return;
+    }
+    // Both halves in consecutive slots, claimed at once
+    const uint32_t slot = __atomic_fetch_add(&ring->head, 2, __ATOMIC_RELAXED);
+    const uint32_t cycles = esp_cpu_get_cycle_count();
+    const uint64_t time_us = esp_timer_get_time();
+    ring->events[slot & (TRACE_RING_SIZE - 1)] = (trace_event_t) {
+        .cycles = cycles,
+        .id = TRACE_SYNC,
+        .phase = TRACE_PHASE_INSTANT,
+        .arg = time_us >> 32,
+    };
+    ring->events[(slot + 1) & (TRACE_RING_SIZE - 1)] = (trace_event_t) {
+        .cycles = (uint32_t) time_us,
+        .id = TRACE_SYNC,
+        .phase = TRACE_PHASE_SYNC_TIME,
+    };
+}
+
+static esp_err_t trace_init(void)
+{
+    for (int c = 0; c < portNUM_PROCESSORS; ++c) {
+        const esp_err_t err = esp_register_freertos_tick_hook_for_cpu(trace_sync_tick, c);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+#define TRACE_BEGIN(id) trace_record((id), TRACE_PHASE_BEGIN, 0)
+#define TRACE_END(id, arg) trace_record((id), TRACE_PHASE_END, (arg))
+#define TRACE_INSTANT(id, arg) trace_record((id), TRACE_PHASE_INSTANT, (arg))
+#else
+#define TRACE_BEGIN(id)
+#define TRACE_END(id, arg)
+#define TRACE_INSTANT(id, arg)
+#endif
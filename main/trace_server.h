@@ -0,0 +1,125 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_ipc.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "trace.h"
+
+// Sends the trace rings to any client connecting to the trace port, then closes the
+// connection. Recording is paused while the rings are sent and they start over
+// empty afterwards. Layout of the dump, little endian:
+//   header: "TLTR", version (TRACE_DUMP_VERSION), core count, CPU MHz (16 bits)
+//   for each core: sync cycles (32 bits), event count (32 bits), sync time in us
+//                  (64 bits), then the events, oldest first, as trace_event_t
+// The sync pair samples the cycle counter of the core and esp_timer at the same moment.
+// Along with the TRACE_SYNC events of the ring, see trace.h, the host uses it to place
+// the events of both cores on a common time line: a busy ring may hold no TRACE_SYNC.
+#if CONFIG_TURBO_TRACE
+static const char *TAG_TRACE = "trace_server";
+static const uint8_t TRACE_DUMP_VERSION = 3;
+
+typedef struct {
+    char magic[4];
+    uint8_t version;
+    uint8_t core_count;
+    uint16_t cpu_mhz;
+} trace_dump_header_t;
+
+typedef struct {
+    uint32_t sync_cycles;
+    uint32_t event_count;
+    int64_t sync_us;
+} trace_dump_core_t;
+
+static void trace_sample_sync(void* arg)
+{
+    trace_dump_core_t* core = (trace_dump_core_t*) arg;
+    core->sync_us = esp_timer_get_time();
+    core->sync_cycles = esp_cpu_get_cycle_count();
+}
+
+static bool trace_send_all(int sock, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*) data;
+    while (size > 0) {
+        const int len = send(sock, bytes, size, 0);
+        if (len < 0) {
+            ESP_LOGE(TAG_TRACE, "Error occurred during sending: errno %d", errno);
+            return false;
+        }
+        bytes += len;
+        size -= len;
+    }
+    return true;
+}
+
+static void trace_dump(int sock)
+{
+    s_trace_enabled = false;
+    // Lets an event being recorded on the other core land
+    vTaskDelay(1);
+
+    const trace_dump_header_t header = {
+        .magic = {'T', 'L', 'T', 'R'},
+        .version = TRACE_DUMP_VERSION,
+        .core_count = portNUM_PROCESSORS,
+        .cpu_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+    };
+    bool ok = trace_send_all(sock, &header, sizeof(header));
+    for (int c = 0; c < portNUM_PROCESSORS && ok; ++c) {
+        trace_ring_t* ring = &s_trace_rings[c];
+        trace_dump_core_t core = {0};
+        esp_ipc_call_blocking(c, trace_sample_sync, &core);
+        const uint32_t head = ring->head;
+        core.event_count = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+        ok = trace_send_all(sock, &core, sizeof(core));
+        // Oldest first: from the head to the end of the ring, then from its start
+        const uint32_t first = (head - core.event_count) & (TRACE_RING_SIZE - 1);
+        const uint32_t tail_count = TRACE_RING_SIZE - first < core.event_count ? TRACE_RING_SIZE - first : core.event_count;
+        ok = ok && trace_send_all(sock, &ring->events[first], tail_count * sizeof(trace_event_t));
+        ok = ok && trace_send_all(sock, ring->events, (core.event_count - tail_count) * sizeof(trace_event_t));
+        ring->head = 0;
+    }
+    s_trace_enabled = true;
+    ESP_LOGI(TAG_TRACE, "Trace %s", ok ? "sent" : "incomplete");
+}
+
+static void trace_server_task(void* pvParameters)
+{
+    static const uint32_t port = 1238;
+    struct sockaddr_in dest_addr = {
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+    };
+
+    int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (listen_sock < 0) {
+        ESP_LOGE(TAG_TRACE, "Unable to create socket: errno %d", errno);
+        vTaskDelete(NULL);
+        return;
+    }
+    int opt = 1;
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (bind(listen_sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) != 0 || listen(listen_sock, 1) != 0) {
+        ESP_LOGE(TAG_TRACE, "Socket unable to listen: errno %d", errno);
+        close(listen_sock);
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(TAG_TRACE, "Socket listening, port %" PRIu32, port);
+
+    while (true) {
+        const int sock = accept(listen_sock, NULL, NULL);
+        if (sock < 0) {
+            ESP_LOGE(TAG_TRACE, "Unable to accept connection: errno %d", errno);
+            break;
+        }
+        trace_dump(sock);
+        shutdown(sock, SHUT_RDWR);
+        close(sock);
+    }
+    close(listen_sock);
+    vTaskDelete(NULL);
+}
+#endif
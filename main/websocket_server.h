@@ -0,0 +1,362 @@
+#include <string.h>
+#include <strings.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/err.h"
+#include "lwip/sockets.h"
+#include "mbedtls/base64.h"
+#include "mbedtls/sha1.h"
+#include "ledstrip_pipeline.h"
+
+static const char *TAG_WEBSOCKET = "websocket_server";
+
+// WebSocket endpoint for browser controllers, ws://<device>:1236/. Each binary message
+// carries one frame, the same bytes as a frame of the raw TCP stream. Messages of
+// another size are dropped. Payloads are received straight into the frame buffers and
+// unmasked in place.
+static const uint32_t WEBSOCKET_SERVER_PORT = 1236;
+static const char WEBSOCKET_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+#define WEBSOCKET_HANDSHAKE_MAX_SIZE 1024
+// Control frames have at most 125 bytes of payload
+#define WEBSOCKET_CONTROL_MAX_SIZE 125
+
+typedef enum {
+    WEBSOCKET_OPCODE_CONTINUATION = 0x0,
+    WEBSOCKET_OPCODE_TEXT = 0x1,
+    WEBSOCKET_OPCODE_BINARY = 0x2,
+    WEBSOCKET_OPCODE_CLOSE = 0x8,
+    WEBSOCKET_OPCODE_PING = 0x9,
+    WEBSOCKET_OPCODE_PONG = 0xA,
+} websocket_opcode_t;
+
+typedef struct {
+    bool fin;
+    uint8_t opcode;
+    uint64_t length;
+    uint8_t mask[4];
+} websocket_header_t;
+
+// Guarded like the TCP server client, see s_tcp_client_lock
+static SemaphoreHandle_t s_websocket_client_lock;
+static StaticSemaphore_t s_websocket_client_lock_storage;
+static int s_websocket_client_sock = -1;
+static uint32_t s_websocket_client_local_ip = 0;
+
+// Same role as tcp_server_drop_clients(), for the WebSocket connection.
+static void websocket_server_drop_clients(uint32_t ip_addr)
+{
+    if (s_websocket_client_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(s_websocket_client_lock, portMAX_DELAY);
+    if (s_websocket_client_sock >= 0 && s_websocket_client_local_ip == ip_addr) {
+        ESP_LOGW(TAG_WEBSOCKET, "Interface of the current connection went down, dropping it");
+        shutdown(s_websocket_client_sock, SHUT_RDWR);
+    }
+    xSemaphoreGive(s_websocket_client_lock);
+}
+
+static bool websocket_recv_all(int sock, void* buffer, size_t size)
+{
+    uint8_t* bytes = buffer;
+    while (size > 0) {
+        const int len = recv(sock, bytes, size, 0);
+        if (len <= 0) {
+            return false;
+        }
+        bytes += len;
+        size -= len;
+    }
+    return true;
+}
+
+// XORs data with the masking key, offset being the position of data[0] in the payload.
+// Bytes are handled one by one until data is word aligned, then a word at a time with
+// the key rotated to match.
+static void websocket_unmask(uint8_t* data, size_t len, const uint8_t mask[4], size_t offset)
+{
+    size_t i = 0;
+    for (; i < len && ((uintptr_t) (data + i) & 3) != 0; ++i) {
+        data[i] ^= mask[(offset + i) & 3];
+    }
+
+    uint8_t rotated[4];
+    for (int k = 0; k < 4; ++k) {
+        rotated[k] = mask[(offset + i + k) & 3];
+    }
+    uint32_t mask_word;
+    memcpy(&mask_word, rotated, sizeof(mask_word));
+    for (; i + 4 <= len; i += 4) {
+        *(uint32_t*) (data + i) ^= mask_word;
+    }
+
+    for (; i < len; ++i) {
+        data[i] ^= mask[(offset + i) & 3];
+    }
+}
+
+// Reads the HTTP upgrade request and answers it. Returns false when the request is not
+// a WebSocket upgrade.
+static bool websocket_handshake(int sock)
+{
+    char request[WEBSOCKET_HANDSHAKE_MAX_SIZE + 1] = "";
+    size_t size = 0;
+    while (strstr(request, "\r\n\r\n") == NULL) {
+        if (size == WEBSOCKET_HANDSHAKE_MAX_SIZE) {
+            ESP_LOGW(TAG_WEBSOCKET, "Handshake larger than %d bytes", WEBSOCKET_HANDSHAKE_MAX_SIZE);
+            return false;
+        }
+        const int len = recv(sock, request + size, WEBSOCKET_HANDSHAKE_MAX_SIZE - size, 0);
+        if (len <= 0) {
+            return false;
+        }
+        size += len;
+        request[size] = '\0';
+    }
+
+    static const char KEY_HEADER[] = "\r\nSec-WebSocket-Key:";
+    const char* key = NULL;
+    for (const char* line = request; (line = strstr(line, "\r\n")) != NULL; line += 2) {
+        if (strncasecmp(line, KEY_HEADER, sizeof(KEY_HEADER) - 1) == 0) {
+            key = line + sizeof(KEY_HEADER) - 1;
+            break;
+        }
+    }
+    if (key == NULL) {
+        ESP_LOGW(TAG_WEBSOCKET, "Not a WebSocket upgrade request");
+        return false;
+    }
+    while (*key == ' ') {
+        ++key;
+    }
+    const size_t key_len = strcspn(key, " \r");
+
+    // Sec-WebSocket-Accept = base64(SHA-1(key + GUID))
+    char accept_input[64 + sizeof(WEBSOCKET_GUID)];
+    if (key_len > 64) {
+        return false;
+    }
+    memcpy(accept_input, key, key_len);
+    memcpy(accept_input + key_len, WEBSOCKET_GUID, sizeof(WEBSOCKET_GUID) - 1);
+    uint8_t digest[20];
+    mbedtls_sha1((const uint8_t*) accept_input, key_len + sizeof(WEBSOCKET_GUID) - 1, digest);
+    uint8_t accept[32];
+    size_t accept_len = 0;
+    mbedtls_base64_encode(accept, sizeof(accept), &accept_len, digest, sizeof(digest));
+
+    char response[160];
+    const int response_len = snprintf(response, sizeof(response),
+                                      "HTTP/1.1 101 Switching Protocols\r\n"
+                                      "Upgrade: websocket\r\n"
+                                      "Connection: Upgrade\r\n"
+                                      "Sec-WebSocket-Accept: %.*s\r\n\r\n",
+                                      (int) accept_len, accept);
+    return send(sock, response, response_len, 0) == response_len;
+}
+
+static bool websocket_recv_header(int sock, websocket_header_t* header)
+{
+    uint8_t bytes[2];
+    if (!websocket_recv_all(sock, bytes, sizeof(bytes))) {
+        return false;
+    }
+    header->fin = bytes[0] & 0x80;
+    header->opcode = bytes[0] & 0x0F;
+    header->length = bytes[1] & 0x7F;
+    if (header->length >= 126) {
+        uint8_t extended[8];
+        const size_t extended_size = header->length == 126 ? 2 : 8;
+        if (!websocket_recv_all(sock, extended, extended_size)) {
+            return false;
+        }
+        header->length = 0;
+        for (size_t i = 0; i < extended_size; ++i) {
+            header->length = header->length << 8 | extended[i];
+        }
+    }
+    // Clients must mask every frame
+    if (!(bytes[1] & 0x80)) {
+        ESP_LOGW(TAG_WEBSOCKET, "Unmasked client frame");
+        return false;
+    }
+    return websocket_recv_all(sock, header->mask, sizeof(header->mask));
+}
+
+static bool websocket_send_control(int sock, websocket_opcode_t opcode, const uint8_t* payload, size_t len)
+{
+    uint8_t frame[2 + WEBSOCKET_CONTROL_MAX_SIZE];
+    frame[0] = 0x80 | opcode;
+    frame[1] = len;
+    memcpy(frame + 2, payload, len);
+    return send(sock, frame, 2 + len, 0) == (int) (2 + len);
+}
+
+// Discards a payload that does not fit in the frame buffer
+static bool websocket_skip(int sock, uint64_t length)
+{
+    uint8_t scratch[64];
+    while (length > 0) {
+        const size_t chunk = length < sizeof(scratch) ? length : sizeof(scratch);
+        if (!websocket_recv_all(sock, scratch, chunk)) {
+            return false;
+        }
+        length -= chunk;
+    }
+    return true;
+}
+
+static void websocket_process_data(const int sock, ledstrip_pipeline_t* pipeline)
+{
+    const size_t frame_size = pipeline->frame_size;
+    uint8_t* frame = ledstrip_pipeline_acquire_frame(pipeline);
+    // Binary message being received, dropped once it exceeds the frame size
+    bool in_message = false;
+    size_t message_size = 0;
+    bool message_dropped = false;
+    uint32_t frames = 0;
+    uint32_t dropped = 0;
+
+    websocket_header_t header;
+    while (websocket_recv_header(sock, &header)) {
+        if (header.opcode == WEBSOCKET_OPCODE_PING || header.opcode == WEBSOCKET_OPCODE_CLOSE) {
+            uint8_t payload[WEBSOCKET_CONTROL_MAX_SIZE];
+            if (header.length > sizeof(payload) || !websocket_recv_all(sock, payload, header.length)) {
+                break;
+            }
+            websocket_unmask(payload, header.length, header.mask, 0);
+            const websocket_opcode_t reply = header.opcode == WEBSOCKET_OPCODE_PING ? WEBSOCKET_OPCODE_PONG
+                                                                                     : WEBSOCKET_OPCODE_CLOSE;
+            websocket_send_control(sock, reply, payload, header.length);
+            if (header.opcode == WEBSOCKET_OPCODE_CLOSE) {
+                ESP_LOGI(TAG_WEBSOCKET, "Connection closed by the client");
+                break;
+            }
+            continue;
+        }
+
+        if (header.opcode == WEBSOCKET_OPCODE_BINARY) {
+            in_message = true;
+            message_size = 0;
+            message_dropped = false;
+        } else if (header.opcode != WEBSOCKET_OPCODE_CONTINUATION || !in_message) {
+            // Text messages and pongs are ignored
+            if (!websocket_skip(sock, header.length)) {
+                break;
+            }
+            continue;
+        }
+
+        if (message_dropped || message_size + header.length > frame_size) {
+            message_dropped = true;
+            if (!websocket_skip(sock, header.length)) {
+                break;
+            }
+        } else {
+            // Payload straight into the frame, unmasked in place chunk by chunk
+            size_t received = 0;
+            while (received < header.length) {
+                const int len = recv(sock, frame + message_size + received, header.length - received, 0);
+                if (len <= 0) {
+                    goto CLOSED;
+                }
+                websocket_unmask(frame + message_size + received, len, header.mask, received);
+                received += len;
+            }
+            message_size += header.length;
+        }
+
+        if (!header.fin) {
+            continue;
+        }
+        in_message = false;
+        if (message_dropped || message_size != frame_size) {
+            ++dropped;
+        } else {
+            const ledstrip_message_t message = {
+                .type = LEDSTRIP_MESSAGE_FRAME,
+                .received_us = esp_timer_get_time(),
+                .frame = frame,
+            };
+            xQueueSend(pipeline->messages, &message, portMAX_DELAY);
+            ++frames;
+            frame = ledstrip_pipeline_acquire_frame(pipeline);
+        }
+    }
+CLOSED:
+    ESP_LOGI(TAG_WEBSOCKET, "Connection ended, %" PRIu32 " frames received, %" PRIu32 " messages of the wrong size dropped",
+             frames, dropped);
+    ledstrip_pipeline_release_frame(pipeline, frame);
+}
+
+static void websocket_server_task(void *pvParameters)
+{
+    ledstrip_pipeline_t* pipeline = (ledstrip_pipeline_t*) pvParameters;
+    s_websocket_client_lock = xSemaphoreCreateMutexStatic(&s_websocket_client_lock_storage);
+    int keepAlive = 1;
+    int keepIdle = 1000;
+    int keepInterval = 1000;
+    int keepCount = 3;
+    int noDelay = 1;
+    struct sockaddr_in dest_addr = {
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+        .sin_family = AF_INET,
+        .sin_port = htons(WEBSOCKET_SERVER_PORT),
+    };
+
+    int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (listen_sock < 0) {
+        ESP_LOGE(TAG_WEBSOCKET, "Unable to create socket: errno %d", errno);
+        vTaskDelete(NULL);
+        return;
+    }
+    int opt = 1;
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    if (bind(listen_sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) != 0) {
+        ESP_LOGE(TAG_WEBSOCKET, "Socket unable to bind: errno %d", errno);
+        goto CLEAN_UP;
+    }
+    if (listen(listen_sock, 1) != 0) {
+        ESP_LOGE(TAG_WEBSOCKET, "Error occurred during listen: errno %d", errno);
+        goto CLEAN_UP;
+    }
+    ESP_LOGI(TAG_WEBSOCKET, "Socket listening, port %" PRIu32, WEBSOCKET_SERVER_PORT);
+
+    while (true) {
+        int sock = accept(listen_sock, NULL, NULL);
+        if (sock < 0) {
+            ESP_LOGE(TAG_WEBSOCKET, "Unable to accept connection: errno %d", errno);
+            break;
+        }
+        setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepAlive, sizeof(int));
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &keepIdle, sizeof(int));
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &keepInterval, sizeof(int));
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &keepCount, sizeof(int));
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(int));
+
+        struct sockaddr_in local_addr;
+        socklen_t local_addr_len = sizeof(local_addr);
+        const bool has_local_addr = getsockname(sock, (struct sockaddr *)&local_addr, &local_addr_len) == 0;
+        xSemaphoreTake(s_websocket_client_lock, portMAX_DELAY);
+        s_websocket_client_local_ip = has_local_addr ? local_addr.sin_addr.s_addr : 0;
+        s_websocket_client_sock = sock;
+        xSemaphoreGive(s_websocket_client_lock);
+
+        if (websocket_handshake(sock)) {
+            ESP_LOGI(TAG_WEBSOCKET, "Client connected");
+            websocket_process_data(sock, pipeline);
+        }
+
+        xSemaphoreTake(s_websocket_client_lock, portMAX_DELAY);
+        s_websocket_client_sock = -1;
+        shutdown(sock, 0);
+        close(sock);
+        xSemaphoreGive(s_websocket_client_lock);
+    }
+
+CLEAN_UP:
+    close(listen_sock);
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+"""Downloads the TCP traffic capture of a board and replays captures to a receiver.
+
+The capturing board must be built with CONFIG_TURBO_CAPTURE. A capture holds the start
+of the last connection to its TCP server: the bytes of every recv() call and their
+arrival time. Replaying it sends the same bytes in the same chunks, paced at the
+original rate, N times faster or as fast as possible, to the same or another receiver.
+
+    tools/replay.py download 192.168.1.50 -o capture.bin
+    tools/replay.py info capture.bin
+    tools/replay.py send capture.bin 192.168.1.51 --speed 1
+    tools/replay.py send capture.bin 192.168.1.51 --speed 4 --repeat 10
+    tools/replay.py send capture.bin 192.168.1.51 --speed max
+
+The dump layout is described in main/capture_server.h. The receiver must have the
+same strip length, CONFIG_TURBO_FRAME_CRC and CONFIG_TURBO_TCP_RECORDS settings as the
+board that captured.
+A CONFIG_TURBO_FRAME_AUTH stream cannot be replayed: its records are sealed for the
+session id of the captured connection, and the receiver rejects them on any other.
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import time
+
+CAPTURE_PORT = 1239
+TCP_SERVER_PORT = 1234
+DUMP_VERSION = 1
+FLAG_FRAME_CRC = 0x01
+FLAG_RECORDS = 0x02
+HEADER = struct.Struct("<4sBBHIIII")
+RECORD = struct.Struct("<II")
+
+
+def download(host, port):
+    chunks = []
+    with socket.create_connection((host, port), timeout=10) as sock:
+        while True:
+            chunk = sock.recv(65536)
+            if not chunk:
+                break
+            chunks.append(chunk)
+    return b"".join(chunks)
+
+
+def parse(dump):
+    magic, version, flags, _, frame_size, record_count, bytes_dropped, records_size = HEADER.unpack_from(dump, 0)
+    if magic != b"TLCP" or version != DUMP_VERSION:
+        raise ValueError("not a capture dump, or unsupported version")
+    if len(dump) < HEADER.size + records_size:
+        raise ValueError("truncated capture: %d of %d bytes" % (len(dump) - HEADER.size, records_size))
+    records = []
+    offset = HEADER.size
+    for _ in range(record_count):
+        time_us, length = RECORD.unpack_from(dump, offset)
+        offset += RECORD.size
+        records.append((time_us, dump[offset:offset + length]))
+        offset += length
+    info = {
+        "frame_crc": bool(flags & FLAG_FRAME_CRC),
+        "records": bool(flags & FLAG_RECORDS),
+        "frame_size": frame_size,
+        "bytes_dropped": bytes_dropped,
+    }
+    return info, records
+
+
+def print_info(info, records):
+    total = sum(len(data) for _, data in records)
+    duration_us = records[-1][0] if records else 0
+    print("%d records, %d bytes over %.3f s, frame size %d, frame CRC %s, record protocol %s"
+          % (len(records), total, duration_us / 1e6, info["frame_size"], "on" if info["frame_crc"] else "off",
+             "on" if info["records"] else "off"))
+    if records:
+        print("recv() sizes: min %d, max %d, mean %.0f"
+              % (min(len(d) for _, d in records), max(len(d) for _, d in records), total / len(records)))
+    if duration_us > 0:
+        print("captured rate: %.2f Mbit/s" % (total * 8 / duration_us))
+    if info["bytes_dropped"]:
+        print("capture ended early, %d bytes were not recorded" % info["bytes_dropped"])
+
+
+def replay(records, host, port, speed):
+    """Sends the records over a new connection. speed is None for as fast as possible.
+    Returns the bytes sent, the elapsed time in seconds and the worst lag behind the
+    schedule in seconds."""
+    total = 0
+    max_lag = 0.0
+    with socket.create_connection((host, port), timeout=10) as sock:
+        # One segment per record where possible, as captured
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        start = time.perf_counter()
+        for time_us, data in records:
+            if speed is not None:
+                due = start + time_us / 1e6 / speed
+                now = time.perf_counter()
+                if due > now:
+                    time.sleep(due - now)
+                else:
+                    max_lag = max(max_lag, now - due)
+            sock.sendall(data)
+            total += len(data)
+        elapsed = time.perf_counter() - start
+        # Lets the receiver read the last frame before the connection closes
+        sock.shutdown(socket.SHUT_WR)
+        try:
+            while sock.recv(4096):
+                pass
+        except OSError:
+            pass
+    return total, elapsed, max_lag
+
+
+def parse_speed(value):
+    if value == "max":
+        return None
+    speed = float(value)
+    if speed <= 0:
+        raise argparse.ArgumentTypeError("the speed must be positive, or max")
+    return speed
+
+
+def load(path):
+    with open(path, "rb") as f:
+        return parse(f.read())
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+    download_parser = commands.add_parser("download", help="download the capture of a board")
+    download_parser.add_argument("host", help="board address")
+    download_parser.add_argument("--port", type=int, default=CAPTURE_PORT)
+    download_parser.add_argument("-o", "--output", default="capture.bin")
+    info_parser = commands.add_parser("info", help="describe a capture")
+    info_parser.add_argument("capture")
+    send_parser = commands.add_parser("send", help="replay a capture to a receiver")
+    send_parser.add_argument("capture")
+    send_parser.add_argument("host", help="receiver address")
+    send_parser.add_argument("--port", type=int, default=TCP_SERVER_PORT)
+    send_parser.add_argument("--speed", type=parse_speed, default=1.0,
+                             help="multiple of the captured rate, or max (default 1)")
+    send_parser.add_argument("--repeat", type=int, default=1, help="replays, each over a new connection")
+    send_parser.add_argument("--pause", type=float, default=0.5,
+                             help="seconds between replays, for the receiver to accept again")
+    args = parser.parse_args()
+
+    if args.command == "download":
+        dump = download(args.host, args.port)
+        info, records = parse(dump)
+        with open(args.output, "wb") as f:
+            f.write(dump)
+        print_info(info, records)
+        print("written to %s" % args.output, file=sys.stderr)
+        return
+
+    info, records = load(args.capture)
+    if args.command == "info":
+        print_info(info, records)
+        return
+
+    if not records:
+        sys.exit("the capture is empty")
+    for run in range(args.repeat):
+        if run > 0:
+            time.sleep(args.pause)
+        total, elapsed, max_lag = replay(records, args.host, args.port, args.speed)
+        rate = total * 8 / elapsed / 1e6 if elapsed > 0 else 0.0
+        frames = total / info["frame_size"] if info["frame_size"] else 0
+        print("run %d: %d bytes in %.3f s, %.2f Mbit/s, ~%.1f frames/s, %.1f ms max behind schedule"
+              % (run + 1, total, elapsed, rate, frames / elapsed if elapsed > 0 else 0.0, max_lag * 1e3))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+"""Downloads the event trace of a board and converts it to a Chrome trace JSON file.
+
+The board must be built with CONFIG_TURBO_TRACE. Open the result in chrome://tracing
+or https://ui.perfetto.dev, one track per core.
+
+    tools/trace_to_chrome.py 192.168.1.50 -o trace.json
+    tools/trace_to_chrome.py --dump trace.bin -o trace.json
+
+The dump layout is described in main/trace_server.h.
+"""
+
+import argparse
+import json
+import socket
+import struct
+import sys
+
+TRACE_PORT = 1238
+DUMP_VERSION = 3
+HEADER = struct.Struct("<4sBBH")
+CORE = struct.Struct("<IIq")
+EVENT = struct.Struct("<IBBH")
+WRAP = 1 << 32
+# Largest difference, in microseconds, between the cycle counter and esp_timer over
+# the interval between two syncs: both run from the same crystal
+SYNC_TOLERANCE_US = 10.0
+
+# Same order as trace_event_id_t in main/trace.h
+EVENT_NAMES = [
+    "recv",
+    "frame_queued",
+    "frame_dequeued",
+    "show_frame",
+    "commit_pixels",
+    "refresh",
+    "rmt_done",
+    "sync",
+]
+TRACE_SYNC = EVENT_NAMES.index("sync")
+PHASE_SYNC_TIME = ord("T")
+
+
+def download(host, port):
+    chunks = []
+    with socket.create_connection((host, port), timeout=10) as sock:
+        while True:
+            chunk = sock.recv(65536)
+            if not chunk:
+                break
+            chunks.append(chunk)
+    return b"".join(chunks)
+
+
+def parse(dump):
+    magic, version, core_count, cpu_mhz = HEADER.unpack_from(dump, 0)
+    if magic != b"TLTR" or version != DUMP_VERSION:
+        raise ValueError("not a trace dump, or unsupported version")
+    offset = HEADER.size
+    cores = []
+    for _ in range(core_count):
+        sync_cycles, count, sync_us = CORE.unpack_from(dump, offset)
+        offset += CORE.size
+        events = [EVENT.unpack_from(dump, offset + i * EVENT.size) for i in range(count)]
+        offset += count * EVENT.size
+        cores.append((sync_cycles, sync_us, events))
+    return cpu_mhz, cores
+
+
+def anchors(events, sync_cycles, sync_us):
+    """Returns the (index, cycles, time_us) points that tie the cycle counter of a core
+    to esp_timer: each TRACE_SYNC of the ring, then the sync pair of the dump, after
+    the last event. A TRACE_SYNC whose second half was overwritten, or the reverse,
+    is skipped."""
+    result = []
+    for i, (cycles, event_id, phase, arg) in enumerate(events[:-1]):
+        following = events[i + 1]
+        if event_id == TRACE_SYNC and phase != PHASE_SYNC_TIME and following[1] == TRACE_SYNC \
+                and following[2] == PHASE_SYNC_TIME:
+            result.append((i, cycles, arg << 32 | following[0]))
+    result.append((len(events), sync_cycles, sync_us))
+    return result
+
+
+def timestamps(cpu_mhz, events, sync_cycles, sync_us):
+    """Returns the time of each event in microseconds, and the (start_us, end_us) spans
+    between two anchors where the cycle counter disagrees with esp_timer. Each event is
+    placed from the anchor before it, or from the first one for the events that precede
+    it: two consecutive events are less than a wrap of the 32-bit counter apart as long
+    as the tick hooks recorded their syncs, which the spans flag otherwise."""
+    points = anchors(events, sync_cycles, sync_us)
+    unresolved = []
+    for (_, cycles_a, us_a), (_, cycles_b, us_b) in zip(points, points[1:]):
+        elapsed_us = ((cycles_b - cycles_a) % WRAP) / cpu_mhz
+        if abs(elapsed_us - (us_b - us_a)) > SYNC_TOLERANCE_US:
+            unresolved.append((us_a, us_b))
+    result = []
+    point = 0
+    for i, (cycles, _, _, _) in enumerate(events):
+        while point + 1 < len(points) and points[point + 1][0] <= i:
+            point += 1
+        index, anchor_cycles, anchor_us = points[point]
+        if index <= i:
+            result.append(anchor_us + ((cycles - anchor_cycles) % WRAP) / cpu_mhz)
+        else:
+            result.append(anchor_us - ((anchor_cycles - cycles) % WRAP) / cpu_mhz)
+    return result, unresolved
+
+
+def to_chrome(cpu_mhz, cores):
+    trace = []
+    unresolved = []
+    for core, (sync_cycles, sync_us, events) in enumerate(cores):
+        trace.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": core,
+                      "args": {"name": "core %d" % core}})
+        times, core_unresolved = timestamps(cpu_mhz, events, sync_cycles, sync_us)
+        unresolved += [(core, start, end) for start, end in core_unresolved]
+        for (cycles, event_id, phase, arg), ts in zip(events, times):
+            if event_id == TRACE_SYNC:
+                continue
+            name = EVENT_NAMES[event_id] if event_id < len(EVENT_NAMES) else "event_%d" % event_id
+            event = {"name": name, "ph": chr(phase), "ts": ts, "pid": 0, "tid": core, "args": {"arg": arg}}
+            if event["ph"] == "i":
+                event["s"] = "t"
+            trace.append(event)
+    return {"traceEvents": trace, "displayTimeUnit": "ns"}, unresolved
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host", nargs="?", help="board address")
+    parser.add_argument("--port", type=int, default=TRACE_PORT)
+    parser.add_argument("--dump", help="read a dump saved with --save instead of downloading it")
+    parser.add_argument("--save", help="also save the raw dump to this file")
+    parser.add_argument("-o", "--output", default="trace.json")
+    args = parser.parse_args()
+
+    if args.dump:
+        with open(args.dump, "rb") as f:
+            dump = f.read()
+    elif args.host:
+        dump = download(args.host, args.port)
+    else:
+        parser.error("a board address or --dump is required")
+    if args.save:
+        with open(args.save, "wb") as f:
+            f.write(dump)
+
+    cpu_mhz, cores = parse(dump)
+    trace, unresolved = to_chrome(cpu_mhz, cores)
+    with open(args.output, "w") as f:
+        json.dump(trace, f)
+    total = sum(len(events) for _, _, events in cores)
+    print("%d events from %d cores written to %s" % (total, len(cores), args.output), file=sys.stderr)
+    # Missed syncs, or a CPU frequency other than the dump's: the events in these spans
+    # may be off by multiples of the counter wrap
+    for core, start, end in unresolved:
+        print("warning: core %d, %.6f s to %.6f s: the cycle counter does not match esp_timer, "
+              "events in this span may be misplaced" % (core, start / 1e6, end / 1e6), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()